@@ -61,3 +61,18 @@ void __am_input_keybrd(AM_INPUT_KEYBRD_T *kbd) {
   kbd->keydown = (k & KEYDOWN_MASK ? true : false);
   kbd->keycode = k & ~KEYDOWN_MASK;
 }
+
+void __am_input_keybuf(AM_INPUT_KEYBUF_T *kb) {
+  int n = 0;
+
+  SDL_LockMutex(key_queue_lock);
+  for (; n < kb->len && key_f != key_r; n++) {
+    int k = key_queue[key_f];
+    key_f = (key_f + 1) % KEY_QUEUE_LEN;
+    kb->buf[n].keydown = (k & KEYDOWN_MASK ? true : false);
+    kb->buf[n].keycode = k & ~KEYDOWN_MASK;
+  }
+  SDL_UnlockMutex(key_queue_lock);
+
+  if (n < kb->len) kb->buf[n].keycode = AM_KEY_NONE;
+}
@@ -21,6 +21,10 @@ void __am_uart_tx(AM_UART_TX_T *uart) {
   putchar(uart->data);
 }
 
+void __am_uart_txbuf(AM_UART_TXBUF_T *uart) {
+  fwrite(uart->buf.start, 1, uart->buf.end - uart->buf.start, stdout);
+}
+
 void __am_uart_rx(AM_UART_RX_T *uart) {
   int ret = fgetc(stdin);
   if (ret == EOF) ret = -1;
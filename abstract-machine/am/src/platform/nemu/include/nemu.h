@@ -27,17 +27,25 @@
 #define MMIO_BASE 0xa0000000
 
 #define SERIAL_PORT     (DEVICE_BASE + 0x00003f8)
+#define SERIAL_TX_ADDR  (SERIAL_PORT + 0x4)
+#define SERIAL_TX_LEN   (SERIAL_PORT + 0x8)
 #define KBD_ADDR        (DEVICE_BASE + 0x0000060)
+#define KBD_RING_ADDR   (MMIO_BASE   + 0x0000800)
 #define RTC_ADDR        (DEVICE_BASE + 0x0000048)
 #define VGACTL_ADDR     (DEVICE_BASE + 0x0000100)
 #define AUDIO_ADDR      (DEVICE_BASE + 0x0000200)
 #define DISK_ADDR       (DEVICE_BASE + 0x0000300)
+#define IPI_ADDR        (MMIO_BASE   + 0x0000e00)
 #define FB_ADDR         (MMIO_BASE   + 0x1000000)
 #define AUDIO_SBUF_ADDR (MMIO_BASE   + 0x1200000)
 
 extern char _pmem_start;
 #define PMEM_SIZE (128 * 1024 * 1024)
 #define PMEM_END  ((uintptr_t)&_pmem_start + PMEM_SIZE)
+// the harts other than hart 0 take their stacks from the end of pmem
+#define MAX_CPU        8
+#define CPU_STACK_SIZE 0x8000
+#define HEAP_END       (PMEM_END - (MAX_CPU - 1) * CPU_STACK_SIZE)
 #define NEMU_PADDR_SPACE \
   RANGE(&_pmem_start, PMEM_END), \
   RANGE(FB_ADDR, FB_ADDR + 0x200000), \
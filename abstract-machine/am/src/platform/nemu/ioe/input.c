@@ -9,3 +9,19 @@ void __am_input_keybrd(AM_INPUT_KEYBRD_T *kbd) {
     kbd->keycode = code & ~KEYDOWN_MASK;
 }
 
+// drain the key ring of NEMU with a single update of its tail
+void __am_input_keybuf(AM_INPUT_KEYBUF_T *kb) {
+    uint32_t head = inl(KBD_RING_ADDR);
+    uint32_t tail = inl(KBD_RING_ADDR + 4);
+    uint32_t len = inl(KBD_RING_ADDR + 8);
+    int n = 0;
+    for (; n < kb->len && tail != head; n++) {
+        uint32_t code = inl(KBD_RING_ADDR + 12 + tail * 4);
+        kb->buf[n].keydown = (code & KEYDOWN_MASK ? true : false);
+        kb->buf[n].keycode = code & ~KEYDOWN_MASK;
+        tail = (tail + 1) % len;
+    }
+    outl(KBD_RING_ADDR + 4, tail);
+    if (n < kb->len) kb->buf[n].keycode = AM_KEY_NONE;
+}
+
@@ -0,0 +1,21 @@
+#include <am.h>
+#include <nemu.h>
+
+void __am_uart_tx(AM_UART_TX_T *uart) {
+  outb(SERIAL_PORT, uart->data);
+}
+
+// NEMU reads the buffer of a bulk write from the physical memory, which
+// is only mapped to the same addresses in pmem, so send the others, such
+// as those in a user address space, byte by byte
+void __am_uart_txbuf(AM_UART_TXBUF_T *uart) {
+  uint32_t len = uart->buf.end - uart->buf.start;
+  if (len == 0) return;
+  uintptr_t start = (uintptr_t)uart->buf.start;
+  if (start < (uintptr_t)&_pmem_start || start > PMEM_END - len) {
+    for (const char *p = uart->buf.start; p != uart->buf.end; p ++) outb(SERIAL_PORT, *p);
+    return;
+  }
+  outl(SERIAL_TX_ADDR, start);
+  outl(SERIAL_TX_LEN, len);
+}
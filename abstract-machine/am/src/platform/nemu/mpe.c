@@ -1,7 +1,38 @@
 #include <am.h>
+#include <nemu.h>
 #include <stdatomic.h>
 #include <klib-macros.h>
 
+#if defined(__riscv)
+// the entry given to mpe_init(), which the other harts are waiting for
+static void (*mpe_entry)() = NULL;
+
+bool mpe_init(void (*entry)()) {
+  __atomic_store_n(&mpe_entry, entry, __ATOMIC_SEQ_CST);
+  entry();
+  panic("MPE entry returns");
+}
+
+// the harts other than hart 0 start here, see start.S
+void __am_mpe_hart() {
+  void (*entry)();
+  while ((entry = __atomic_load_n(&mpe_entry, __ATOMIC_SEQ_CST)) == NULL) {
+    asm volatile("wfi");
+  }
+  entry();
+  panic("MPE entry returns");
+}
+
+int cpu_count() {
+  return inl(IPI_ADDR);
+}
+
+int cpu_current() {
+  int id;
+  asm volatile("csrr %0, mhartid" : "=r"(id));
+  return id;
+}
+#else
 bool mpe_init(void (*entry)()) {
   entry();
   panic("MPE entry returns");
@@ -14,6 +45,7 @@ int cpu_count() {
 int cpu_current() {
   return 0;
 }
+#endif
 
 int atomic_xchg(int *addr, int newval) {
   return atomic_exchange(addr, newval);
@@ -2,6 +2,11 @@
 #include <riscv/riscv.h>
 #include <klib.h>
 
+#define IRQ_TIMER    0x80000007  // machine timer interrupt
+#define IRQ_EXTERNAL 0x8000000b  // machine external interrupt
+#define MSTATUS_MIE  (1 << 3)
+#define MIE_MASK     ((1 << 7) | (1 << 11))  // MTIE and MEIE
+
 static Context* (*user_handler)(Event, Context*) = NULL;
 
 Context* __am_irq_handle(Context *c) {
@@ -37,6 +42,12 @@ Context* __am_irq_handle(Context *c) {
         case 19:
             ev.event = EVENT_SYSCALL;
             break;
+        case IRQ_TIMER:
+            ev.event = EVENT_IRQ_TIMER;
+            break;
+        case IRQ_EXTERNAL:
+            ev.event = EVENT_IRQ_IODEV;
+            break;
       default: ev.event = EVENT_ERROR; break;
     }
 
@@ -72,8 +83,16 @@ void yield() {
 }
 
 bool ienabled() {
-  return false;
+  uintptr_t mstatus;
+  asm volatile("csrr %0, mstatus" : "=r"(mstatus));
+  return (mstatus & MSTATUS_MIE) != 0;
 }
 
 void iset(bool enable) {
+  if (enable) {
+    asm volatile("csrs mie, %0" : : "r"(MIE_MASK));
+    asm volatile("csrs mstatus, %0" : : "r"(MSTATUS_MIE));
+  } else {
+    asm volatile("csrc mstatus, %0" : : "r"(MSTATUS_MIE));
+  }
 }
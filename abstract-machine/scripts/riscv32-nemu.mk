@@ -1,7 +1,13 @@
 include $(AM_HOME)/scripts/isa/riscv.mk
 include $(AM_HOME)/scripts/platform/nemu.mk
 CFLAGS  += -DISA_H=\"riscv/riscv.h\"
-COMMON_CFLAGS += -march=rv32im_zicsr -mabi=ilp32   # overwrite
+# the single letter extensions can be given by RV_ISA, e.g. RV_ISA=rv32imafdc,
+# and more extensions by RV_EXT, e.g. RV_EXT=_zba_zbb
+# the floating point registers are not saved in the context, and the ABI is
+# still ilp32 to link with the libraries built without them
+RV_ISA ?= rv32imac
+RV_EXT ?=
+COMMON_CFLAGS += -march=$(RV_ISA)_zicsr$(RV_EXT) -mabi=ilp32 # overwrite
 LDFLAGS       += -melf32lriscv                     # overwrite
 
 AM_SRCS += riscv/nemu/start.S \
@@ -15,28 +15,35 @@ static const char *keyname[256] __attribute__((used)) = {
 };
 
 size_t serial_write(const void *buf, size_t offset, size_t len) {
-    char *out = (char *) buf;
-    for (int i = 0; i < len; ++i) {
-        putch(out[i]);
-    }
+    // hand the whole string to the serial device at once instead of putch() per byte
+    io_write(AM_UART_TXBUF, RANGE(buf, (const char *) buf + len));
     return len;
 }
 
+// the longest event is "kd APPLICATION\n"
+#define EVENT_MAX_LEN 16
+#define EVENT_BATCH 32
+
+// return as many events as `buf' can hold, one per line
 size_t events_read(void *buf, size_t offset, size_t len) {
-    AM_INPUT_KEYBRD_T kbd = io_read(AM_INPUT_KEYBRD);
-    if (AM_KEY_NONE == kbd.keycode) {
-        return 0;
+    AM_INPUT_KEYBRD_T kbd[EVENT_BATCH];
+    int n = len / EVENT_MAX_LEN;
+    if (n == 0) {
+        // too small for a whole event, so cut one short as snprintf() does
+        char ev[EVENT_MAX_LEN];
+        size_t ret = events_read(ev, offset, EVENT_MAX_LEN);
+        if (ret > len) ret = len;
+        memcpy(buf, ev, ret);
+        return ret;
     }
-    char res[64];
-    memset(res, 0, 64);
-    if (kbd.keydown) {
-        assert(sprintf(res, "kd %s", keyname[kbd.keycode]) <= 64);
-    } else {
-        assert(sprintf(res, "ku %s", keyname[kbd.keycode]) <= 64);
+    if (n > EVENT_BATCH) n = EVENT_BATCH;
+    io_write(AM_INPUT_KEYBUF, kbd, n);
+
+    char *p = buf;
+    for (int i = 0; i < n && kbd[i].keycode != AM_KEY_NONE; i++) {
+        p += sprintf(p, "%s %s\n", kbd[i].keydown ? "kd" : "ku", keyname[kbd[i].keycode]);
     }
-    size_t real_len = strlen(res);
-    strcpy(buf, res);
-    return real_len;
+    return p - (char *) buf;
 }
 
 size_t dispinfo_read(void *buf, size_t offset, size_t len) {
@@ -9,6 +9,9 @@ static Context* do_event(Event e, Context* c) {
         case EVENT_SYSCALL:
             do_syscall(c);
             break;
+        case EVENT_IRQ_TIMER:
+        case EVENT_IRQ_IODEV:
+            break;
         default: panic("Unhandled event ID = %d", e.event);
     }
     return c;
@@ -22,9 +22,25 @@ uint32_t NDL_GetTicks() {
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+// /dev/events returns a batch of events, one per line,
+// so keep the remaining ones for the following calls
+static char evbuf[512];
+static int evbuf_len = 0, evbuf_pos = 0;
+
 int NDL_PollEvent(char *buf, int len) {
-  int ret = read(evtdev, buf, len);
-  return ret == 0 ? 0 : 1;
+  if (evbuf_pos >= evbuf_len) {
+    evbuf_len = read(evtdev, evbuf, sizeof(evbuf));
+    evbuf_pos = 0;
+    if (evbuf_len <= 0) { evbuf_len = 0; return 0; }
+  }
+  char *p = evbuf + evbuf_pos;
+  char *end = memchr(p, '\n', evbuf_len - evbuf_pos);
+  int n = (end ? end : evbuf + evbuf_len) - p;
+  evbuf_pos += n + (end != NULL);
+  if (n > len - 1) n = len - 1;
+  memcpy(buf, p, n);
+  buf[n] = '\0';
+  return 1;
 }
 
 void NDL_OpenCanvas(int *w, int *h) {
@@ -44,6 +44,23 @@ typedef MUXDEF(PMEM64, uint64_t, uint32_t) paddr_t;
 #define FMT_PADDR MUXDEF(PMEM64, "0x%016" PRIx64, "0x%08" PRIx32)
 typedef uint16_t ioaddr_t;
 
+// the state of a machine, which is private to the host thread running
+// the machine if several machines run in the same process
+#ifdef CONFIG_MULTI_INSTANCE
+#define MACHINE_LOCAL __thread
+#else
+#define MACHINE_LOCAL
+#endif
+
+// the state of a hart, which is private to the host thread running the
+// hart if the machine has several harts (a hart is also a part of the
+// machine, so it is thread-local when running several machines as well)
+#if defined(CONFIG_MULTI_INSTANCE) || defined(CONFIG_MULTI_HART)
+#define HART_LOCAL __thread
+#else
+#define HART_LOCAL
+#endif
+
 #include <debug.h>
 
 #endif
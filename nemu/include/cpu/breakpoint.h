@@ -0,0 +1,39 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_BREAKPOINT_H__
+#define __CPU_BREAKPOINT_H__
+
+#include <common.h>
+
+// number of breakpoints, the execution loop only looks them up when it is not zero
+extern int g_nr_bp;
+
+// number of breakpoints in the pages sharing the same slot, the hash set
+// is only searched when the page of the PC may contain a breakpoint
+#define BP_PAGE_SHIFT 12
+#define NR_BP_PAGE 4096
+extern uint16_t bp_page[NR_BP_PAGE];
+
+bool bp_insert(vaddr_t pc);
+bool bp_remove(vaddr_t pc);
+bool bp_find(vaddr_t pc);
+void bp_foreach(void (*f)(vaddr_t pc));
+
+static inline bool bp_check(vaddr_t pc) {
+  return g_nr_bp > 0 && bp_page[(pc >> BP_PAGE_SHIFT) % NR_BP_PAGE] != 0 && bp_find(pc);
+}
+
+#endif
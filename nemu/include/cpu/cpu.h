@@ -19,6 +19,29 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+// the same as cpu_exec(), but never print the executed instructions
+void cpu_exec_quiet(uint64_t n);
+
+#ifdef CONFIG_MULTI_HART
+#define NR_HARTS CONFIG_NR_HARTS
+extern HART_LOCAL int g_hartid;
+// let `hartid' check its interrupts after the current instruction
+void hart_wakeup(int hartid);
+#else
+#define NR_HARTS 1
+#define g_hartid 0
+#endif
+
+#ifdef CONFIG_HPM_EVENTS
+// the events counted for the performance counters of the guest
+typedef struct {
+  uint64_t load, store, branch, mmio, trap;
+} HPMEvents;
+extern HART_LOCAL HPMEvents g_hpm;
+#define HPM_COUNT(event) (g_hpm.event ++)
+#else
+#define HPM_COUNT(event) ((void) 0)
+#endif
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
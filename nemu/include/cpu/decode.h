@@ -23,6 +23,8 @@ typedef struct Decode {
   vaddr_t snpc; // static next pc
   vaddr_t dnpc; // dynamic next pc
   ISADecodeInfo isa;
+  IFDEF(CONFIG_DECODE_CACHE, uint64_t budget); // number of instructions which may be executed
+  IFDEF(CONFIG_DECODE_CACHE, int ninst);        // number of instructions executed in the last step
   IFDEF(CONFIG_ITRACE, char logbuf[128]);
 } Decode;
 
@@ -96,7 +98,8 @@ finish:
   } \
 } while (0)
 
-#define INSTPAT_START(name) { const void ** __instpat_end = &&concat(__instpat_end_, name);
+// static, since a cached instruction may jump into the middle of the block
+#define INSTPAT_START(name) { static const void *__instpat_end = &&concat(__instpat_end_, name);
 #define INSTPAT_END(name)   concat(__instpat_end_, name): ; }
 
 #endif
@@ -14,13 +14,14 @@
 ***************************************************************************************/
 
 #ifndef __CPU_IFETCH_H__
+#define __CPU_IFETCH_H__
 
 #include <memory/vaddr.h>
 
 extern void trace_inst(word_t pc, uint32_t inst);
 
 static inline uint32_t inst_fetch(vaddr_t *pc, int len) {
-  uint32_t inst = vaddr_ifetch(*pc, len);
+  uint32_t inst = (likely(vaddr_direct(*pc, len)) ? host_read(guest_to_host(*pc), len) : vaddr_ifetch(*pc, len));
   (*pc) += len;
     IFDEF(IRINGBUF, trace_inst(*pc, inst));  // for irringbuf trace
   return inst;
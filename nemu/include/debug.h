@@ -32,6 +32,7 @@
       IFNDEF(CONFIG_TARGET_AM, extern FILE* log_fp; fflush(log_fp)); \
       extern void assert_fail_msg(); \
       assert_fail_msg(); \
+      IFDEF(CONFIG_MULTI_INSTANCE, extern void machine_abort(); machine_abort()); \
       assert(cond); \
     } \
   } while (0)
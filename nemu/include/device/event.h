@@ -0,0 +1,55 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include <common.h>
+
+typedef void (*event_handler_t) ();
+
+// register a handler which is called every `period_us' microseconds
+void add_device_event(event_handler_t h, uint64_t period_us);
+
+// the clock followed by devices (unit: us), which is the host clock
+// or the virtual clock driven by guest instructions
+uint64_t device_time();
+#ifdef CONFIG_VIRTUAL_TIME
+// let the virtual clock jump forward by at most `max_us' microseconds,
+// stopping at the next device event
+void device_skip_idle(uint64_t max_us);
+#endif
+
+// called when the guest waits for an interrupt, let the device time
+// go by until the next device event without executing instructions
+void device_idle();
+
+// the execution loop calls device_update() once `g_nr_guest_inst'
+// reaches this value, so it only needs to check a single counter;
+// with several harts, only hart 0 updates the devices and the other
+// harts just check their interrupts
+extern HART_LOCAL uint64_t g_device_deadline;
+void device_update();
+
+// the other harts also clear the deadline of a hart by hart_wakeup(),
+// so it is always accessed atomically
+static inline uint64_t device_deadline() {
+  return __atomic_load_n(&g_device_deadline, __ATOMIC_RELAXED);
+}
+static inline void set_device_deadline(uint64_t deadline) {
+  __atomic_store_n(&g_device_deadline, deadline, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,35 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __DEVICE_INTR_H__
+#define __DEVICE_INTR_H__
+
+#include <common.h>
+
+// interrupt sources of devices, which are mapped to the interrupt
+// numbers of the guest ISA by isa_query_intr()
+enum { DEV_INTR_TIMER, DEV_INTR_EXTERNAL, NR_DEV_INTR };
+
+// bitmap of the sources which have raised an interrupt not yet taken
+extern MACHINE_LOCAL uint32_t g_dev_intr;
+
+void dev_raise_intr(int src);
+
+#ifdef CONFIG_HAS_IPI
+// whether the software interrupt of `hartid' is pending
+bool dev_ipi_pending(int hartid);
+#endif
+
+#endif
@@ -53,4 +53,10 @@ void add_mmio_map(const char *name, paddr_t addr,
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
 
+#ifdef CONFIG_MULTI_HART
+// the devices are not thread-safe, so the harts access them one by one
+void device_lock();
+void device_unlock();
+#endif
+
 #endif
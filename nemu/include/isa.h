@@ -27,15 +27,23 @@ typedef concat(__GUEST_ISA__, _ISADecodeInfo) ISADecodeInfo;
 // monitor
 extern unsigned char isa_logo[];
 void init_isa();
+#ifdef CONFIG_MULTI_HART
+void isa_init_hart(); // initialize the current hart other than hart 0
+#endif
 
 // reg
-extern CPU_state cpu;
+extern HART_LOCAL CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
 
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+// the host FPU is shared with the host code, such as the devices
+#ifndef isa_fp_save
+void isa_fp_save();    // move the guest state in the host FPU into the CPU state
+void isa_fp_restore(); // drop the state left in the host FPU by the host code
+#endif
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
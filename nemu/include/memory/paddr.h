@@ -22,15 +22,49 @@
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
 #define RESET_VECTOR (PMEM_LEFT + CONFIG_PC_RESET_OFFSET)
 
+#if   defined(CONFIG_PMEM_MALLOC)
+extern MACHINE_LOCAL uint8_t *pmem;
+#else
+extern uint8_t pmem[];
+#endif
+
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
-uint8_t* guest_to_host(paddr_t paddr);
+static inline uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
-paddr_t host_to_guest(uint8_t *haddr);
+static inline paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
 static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+// if all the `len' bytes from `addr' are in pmem
+static inline bool in_pmem_range(paddr_t addr, paddr_t len) {
+  return len <= CONFIG_MSIZE && addr - CONFIG_MBASE <= CONFIG_MSIZE - len;
+}
+
+#ifdef CONFIG_SMC_DETECT
+#define PMEM_PAGE_SHIFT 12
+#define PMEM_PAGE_SIZE  (1u << PMEM_PAGE_SHIFT)
+
+// if a page of pmem holds instructions in the decode cache
+extern MACHINE_LOCAL uint8_t pmem_code[];
+void pmem_code_written(paddr_t addr, int len);
+
+static inline void pmem_code_mark(paddr_t addr) {
+  pmem_code[(addr - CONFIG_MBASE) >> PMEM_PAGE_SHIFT] = 1;
+}
+#endif
+
+// called when the `len' bytes from `addr' are written, which are all in pmem
+static inline void pmem_code_check(paddr_t addr, int len) {
+#ifdef CONFIG_SMC_DETECT
+  paddr_t off = addr - CONFIG_MBASE;
+  if (unlikely(pmem_code[off >> PMEM_PAGE_SHIFT] | pmem_code[(off + len - 1) >> PMEM_PAGE_SHIFT])) {
+    pmem_code_written(addr, len);
+  }
+#endif
+}
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
@@ -17,11 +17,39 @@
 #define __MEMORY_VADDR_H__
 
 #include <common.h>
+#include <memory/paddr.h>
+#include <memory/host.h>
 
 word_t vaddr_ifetch(vaddr_t addr, int len);
 word_t vaddr_read(vaddr_t addr, int len);
 void vaddr_write(vaddr_t addr, int len, word_t data);
 
+/* The accesses of a fixed width are inlined to pmem with one range check
+ * for all the bytes, since a virtual address is the physical address.
+ * Misaligned accesses are done by the host. The others, such as those to
+ * MMIO and those traced, go to the generic functions above.
+ */
+static inline bool vaddr_direct(vaddr_t addr, int len) {
+  return MUXDEF(CONFIG_MTRACE, false, in_pmem_range(addr, len));
+}
+
+#define def_vaddr_access(bits) \
+  static inline word_t concat(vaddr_read, bits)(vaddr_t addr) { \
+    if (likely(vaddr_direct(addr, bits / 8))) return host_read(guest_to_host(addr), bits / 8); \
+    return vaddr_read(addr, bits / 8); \
+  } \
+  static inline void concat(vaddr_write, bits)(vaddr_t addr, word_t data) { \
+    if (likely(vaddr_direct(addr, bits / 8))) { \
+      host_write(guest_to_host(addr), bits / 8, data); \
+      pmem_code_check(addr, bits / 8); \
+    } else vaddr_write(addr, bits / 8, data); \
+  }
+
+def_vaddr_access(8)
+def_vaddr_access(16)
+def_vaddr_access(32)
+IFDEF(CONFIG_ISA64, def_vaddr_access(64))
+
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
 #define PAGE_MASK         (PAGE_SIZE - 1)
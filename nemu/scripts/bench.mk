@@ -0,0 +1,110 @@
+#***************************************************************************************
+# Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Run every image in BENCH_IMGS for BENCH_RUNS times in batch mode, and
+# summarize the statistic of NEMU in BENCH_OUT as JSON. An entry of
+# BENCH_IMGS is either the path of an image, or the name of a benchmark
+# in am-kernels, which is built for BENCH_ARCH first.
+#
+# The result is compared with BENCH_BASELINE if it exists, and a drop of
+# the median MIPS larger than BENCH_TOLERANCE percent fails the target.
+# Use `make bench-save' to store the result as the new baseline.
+#
+# With BENCH_PERF=1, every run is wrapped in `perf stat' to count the
+# DTLB misses of the host, which are reported as the median of the runs.
+
+AM_KERNELS_HOME ?= $(NEMU_HOME)/../am-kernels
+BENCH_IMGS      ?= coremark dhrystone microbench
+BENCH_RUNS      ?= 5
+BENCH_ARCH      ?= $(GUEST_ISA)-nemu
+BENCH_OUT       ?= $(BUILD_DIR)/bench.json
+BENCH_BASELINE  ?= $(NEMU_HOME)/bench-baseline.json
+BENCH_TOLERANCE ?= 5
+
+BENCH_PERF      ?=
+
+COMMA := ,
+BENCH_RAW = $(BUILD_DIR)/bench-raw.txt
+BENCH_WRAP = $(if $(BENCH_PERF),perf stat -x$(COMMA) -e dTLB-load-misses$(COMMA)dTLB-store-misses)
+
+# set `name' and `img' for the entry `b' of an image list
+BENCH_RESOLVE = \
+	  if [ -f $$b ]; then img=$$b; name=`basename $$b .bin`; \
+	  else \
+	    name=$$b; img=$(AM_KERNELS_HOME)/benchmarks/$$b/build/$$b-$(BENCH_ARCH).bin; \
+	    $(MAKE) -s -C $(AM_KERNELS_HOME)/benchmarks/$$b ARCH=$(BENCH_ARCH) image; \
+	  fi
+
+bench: $(BINARY)
+	@rm -f $(BENCH_RAW)
+	@set -e; for b in $(BENCH_IMGS); do \
+	  $(BENCH_RESOLVE); \
+	  for i in `seq $(BENCH_RUNS)`; do \
+	    echo "+ BENCH $$name ($$i/$(BENCH_RUNS))"; \
+	    $(BENCH_WRAP) $(BINARY) -b -l /dev/null $$img > $(BUILD_DIR)/bench-run.txt 2>&1 || true; \
+	    grep -q "HIT GOOD TRAP" $(BUILD_DIR)/bench-run.txt || \
+	      { tail -20 $(BUILD_DIR)/bench-run.txt; echo "$$name does not hit good trap"; exit 1; }; \
+	    awk -v name=$$name ' \
+	      function num(s) { gsub(/[^0-9]/, "", s); return s + 0 } \
+	      /simulation frequency = / { split($$0, a, "simulation frequency = "); split(a[2], b, " "); ips = num(b[1]) } \
+	      /host max RSS = / { split($$0, a, "host max RSS = "); split(a[2], b, " "); rss = num(b[1]) } \
+	      /,dTLB-(load|store)-misses/ { split($$0, a, ","); tlb += a[1] } \
+	      END { printf "%s %.3f %d %d\n", name, ips / 1e6, rss, tlb }' \
+	      $(BUILD_DIR)/bench-run.txt >> $(BENCH_RAW); \
+	  done; \
+	done
+	@awk -v runs=$(BENCH_RUNS) -v perf=$(if $(BENCH_PERF),1,0) -v commit=`git -C $(NEMU_HOME) rev-parse --short HEAD 2>/dev/null || echo unknown` ' \
+	  { if (!($$1 in n)) order[++nr] = $$1; k = $$1; v[k, ++n[k]] = $$2; sum[k] += $$2; if ($$3 > rss[k]) rss[k] = $$3; t[k, n[k]] = $$4 } \
+	  END { \
+	    printf "{\n  \"commit\": \"%s\",\n  \"runs\": %d,\n  \"benchmarks\": {\n", commit, runs; \
+	    for (j = 1; j <= nr; j++) { \
+	      k = order[j]; m = n[k]; \
+	      for (x = 1; x <= m; x++) for (y = x + 1; y <= m; y++) \
+	        if (v[k, y] < v[k, x]) { u = v[k, x]; v[k, x] = v[k, y]; v[k, y] = u } \
+	      med = (m % 2 ? v[k, (m + 1) / 2] : (v[k, m / 2] + v[k, m / 2 + 1]) / 2); \
+	      mean = sum[k] / m; var = 0; \
+	      for (x = 1; x <= m; x++) var += (v[k, x] - mean) ^ 2; \
+	      var = (m > 1 ? var / (m - 1) : 0); \
+	      for (x = 1; x <= m; x++) for (y = x + 1; y <= m; y++) \
+	        if (t[k, y] < t[k, x]) { u = t[k, x]; t[k, x] = t[k, y]; t[k, y] = u } \
+	      tlb = (perf ? sprintf(", \"dtlb_misses\": %d", t[k, int((m + 1) / 2)]) : ""); \
+	      printf "    \"%s\": { \"median_mips\": %.3f, \"mean_mips\": %.3f, \"variance\": %.6f, \"max_rss_kb\": %d%s }%s\n", \
+	        k, med, mean, var, rss[k], tlb, (j < nr ? "," : ""); \
+	    } \
+	    printf "  }\n}\n"; \
+	  }' $(BENCH_RAW) > $(BENCH_OUT)
+	@cat $(BENCH_OUT)
+	@if [ -f $(BENCH_BASELINE) ]; then \
+	  awk -v tol=$(BENCH_TOLERANCE) ' \
+	    function mips(s) { sub(/.*"median_mips": /, "", s); sub(/,.*/, "", s); return s + 0 } \
+	    function key(s) { sub(/^ *"/, "", s); sub(/".*/, "", s); return s } \
+	    /"median_mips"/ { if (FNR == NR) base[key($$0)] = mips($$0); else cur[key($$0)] = mips($$0); order[++nr] = key($$0) } \
+	    END { \
+	      bad = 0; printf "\n%-16s %12s %12s %9s\n", "benchmark", "baseline", "current", "change"; \
+	      for (j = 1; j <= nr; j++) { \
+	        k = order[j]; if (!(k in cur) || !(k in base) || seen[k]++) continue; \
+	        d = (base[k] > 0 ? (cur[k] - base[k]) * 100 / base[k] : 0); \
+	        printf "%-16s %12.3f %12.3f %+8.2f%%%s\n", k, base[k], cur[k], d, (d < -tol ? "  REGRESSION" : ""); \
+	        if (d < -tol) bad = 1; \
+	      } \
+	      exit bad; \
+	    }' $(BENCH_BASELINE) $(BENCH_OUT); \
+	else echo "No baseline at $(BENCH_BASELINE), run 'make bench-save' to store one"; fi
+
+bench-save:
+	@test -f $(BENCH_OUT) || $(MAKE) -s bench
+	cp $(BENCH_OUT) $(BENCH_BASELINE)
+
+.PHONY: bench bench-save
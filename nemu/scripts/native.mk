@@ -39,6 +39,10 @@ run: run-env
 gdb: run-env
 	gdb -s $(BINARY) --args $(NEMU_EXEC)
 
+include $(NEMU_HOME)/scripts/bench.mk
+include $(NEMU_HOME)/scripts/pgo.mk
+include $(NEMU_HOME)/scripts/test.mk
+
 clean-tools = $(dir $(shell find ./tools -maxdepth 2 -mindepth 2 -name "Makefile"))
 $(clean-tools):
 	-@$(MAKE) -s -C $@ clean
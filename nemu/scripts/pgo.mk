@@ -0,0 +1,57 @@
+#***************************************************************************************
+# Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Two-stage profile-guided build, see CONFIG_CC_PGO. An instrumented NEMU
+# is built with PGO_STAGE=gen and trained with every image in PGO_IMGS,
+# whose entries are resolved as the ones of BENCH_IMGS. Then NEMU is built
+# again with the profile in PGO_PROFILE.
+
+ifdef CONFIG_CC_PGO
+PGO_IMGS ?= $(BENCH_IMGS)
+
+# run the binary $(1) with every image in PGO_IMGS
+define pgo_train
+	@set -e; for b in $(PGO_IMGS); do \
+	  $(BENCH_RESOLVE); \
+	  echo "+ PGO TRAIN $$name"; \
+	  $(1) -b -l /dev/null $$img > $(PGO_DIR)/train.txt 2>&1 || true; \
+	  grep -q "HIT GOOD TRAP" $(PGO_DIR)/train.txt || \
+	    { tail -20 $(PGO_DIR)/train.txt; echo "$$name does not hit good trap"; exit 1; }; \
+	done
+endef
+
+pgo:
+	-rm -rf $(PGO_DIR) $(OBJ_DIR) $(BINARY)
+	@mkdir -p $(PGO_DIR)
+	$(MAKE) -s PGO_STAGE=gen app
+	$(call pgo_train,$(BINARY))
+ifdef CONFIG_CC_CLANG
+	llvm-profdata merge -o $(PGO_PROFILE)/default.profdata $(PGO_PROFILE)/*.profraw
+endif
+	-rm -rf $(OBJ_DIR) $(BINARY)
+	$(MAKE) -s app
+ifdef CONFIG_CC_PGO_BOLT
+	llvm-bolt $(BINARY) -o $(PGO_DIR)/nemu-bolt-inst -instrument \
+	  -instrumentation-file=$(PGO_DIR)/bolt.fdata -instrumentation-file-append-pid
+	$(call pgo_train,$(PGO_DIR)/nemu-bolt-inst)
+	merge-fdata $(PGO_DIR)/bolt.fdata.* > $(PGO_DIR)/bolt.fdata
+	llvm-bolt $(BINARY) -o $(BINARY).bolt -data=$(PGO_DIR)/bolt.fdata \
+	  -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions -split-all-cold
+	mv $(BINARY).bolt $(BINARY)
+endif
+	@echo "$(BINARY) is built with the profile in $(PGO_PROFILE)"
+
+.PHONY: pgo
+endif
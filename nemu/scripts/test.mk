@@ -0,0 +1,45 @@
+#***************************************************************************************
+# Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Assemble the tests in tests/$(GUEST_ISA) and run each of them in batch
+# mode, where a test passes when it hits the good trap. The tests need the
+# cross binutils of TEST_CROSS_COMPILE, and the ones in TEST_SKIP, which
+# depend on the extensions not enabled, are not run.
+
+TEST_CROSS_COMPILE ?= riscv64-linux-gnu-
+TEST_AS      ?= $(TEST_CROSS_COMPILE)as
+TEST_LD      ?= $(TEST_CROSS_COMPILE)ld
+TEST_ASFLAGS ?= -march=rv32imac_zicsr_zifencei_zba_zbb -mabi=ilp32 -mno-relax
+TEST_LDFLAGS ?= -melf32lriscv -N -Ttext=0x80000000 -e _start
+TEST_SKIP    ?= $(if $(CONFIG_RV_ZB),,zb) $(if $(CONFIG_RVC),,smc)
+
+TEST_DIR       = $(NEMU_HOME)/tests/$(GUEST_ISA)
+TEST_BUILD_DIR = $(BUILD_DIR)/tests
+TESTS = $(filter-out $(TEST_SKIP),$(basename $(notdir $(wildcard $(TEST_DIR)/*.S))))
+
+$(TEST_BUILD_DIR)/%.elf: $(TEST_DIR)/%.S
+	@mkdir -p $(TEST_BUILD_DIR)
+	@echo + AS $(notdir $<)
+	@$(TEST_AS) $(TEST_ASFLAGS) -o $(@:.elf=.o) $<
+	@$(TEST_LD) $(TEST_LDFLAGS) -o $@ $(@:.elf=.o)
+
+test: $(BINARY) $(TESTS:%=$(TEST_BUILD_DIR)/%.elf)
+	@bad=0; for t in $(TESTS); do \
+	  $(BINARY) -b -l /dev/null $(TEST_BUILD_DIR)/$$t.elf > $(TEST_BUILD_DIR)/$$t.txt 2>&1; \
+	  if grep -q "HIT GOOD TRAP" $(TEST_BUILD_DIR)/$$t.txt; then echo "+ TEST $$t: pass"; \
+	  else tail -5 $(TEST_BUILD_DIR)/$$t.txt; echo "+ TEST $$t: FAIL"; bad=1; fi; \
+	done; exit $$bad
+
+.PHONY: test
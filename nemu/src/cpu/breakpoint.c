@@ -0,0 +1,93 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/breakpoint.h>
+
+/* Breakpoints are kept in an open-addressing hash set of PCs, so that
+ * checking the PC of every instruction stays cheap when they are set.
+ * The counters in `bp_page' filter out the pages without breakpoints
+ * before the hash set is searched.
+ */
+
+#define NR_SLOT 1024 // must be a power of 2
+#define EMPTY ((vaddr_t)-1)
+
+static vaddr_t slot[NR_SLOT];
+static bool slot_init = false;
+int g_nr_bp = 0;
+uint16_t bp_page[NR_BP_PAGE] = {};
+
+static inline uint16_t *page_cnt(vaddr_t pc) {
+  return &bp_page[(pc >> BP_PAGE_SHIFT) % NR_BP_PAGE];
+}
+
+static inline int hash(vaddr_t pc) {
+  return ((uint32_t)pc * 2654435761u >> 2) & (NR_SLOT - 1);
+}
+
+// return the slot holding `pc', or the empty slot where it should be inserted
+static int lookup(vaddr_t pc) {
+  if (!slot_init) {
+    for (int i = 0; i < NR_SLOT; i ++) slot[i] = EMPTY;
+    slot_init = true;
+  }
+  int i = hash(pc);
+  while (slot[i] != pc && slot[i] != EMPTY) i = (i + 1) & (NR_SLOT - 1);
+  return i;
+}
+
+bool bp_find(vaddr_t pc) {
+  return slot[lookup(pc)] == pc;
+}
+
+bool bp_insert(vaddr_t pc) {
+  Assert(pc != EMPTY, "invalid breakpoint address " FMT_WORD, pc);
+  int i = lookup(pc);
+  if (slot[i] == pc) return false;
+  // keep at least one empty slot so that lookup() terminates
+  if (g_nr_bp == NR_SLOT - 1) return false;
+  slot[i] = pc;
+  g_nr_bp ++;
+  (*page_cnt(pc)) ++;
+  return true;
+}
+
+bool bp_remove(vaddr_t pc) {
+  int i = lookup(pc);
+  if (slot[i] != pc) return false;
+  // move the following entries of the probing chain back
+  int j = i;
+  while (true) {
+    j = (j + 1) & (NR_SLOT - 1);
+    if (slot[j] == EMPTY) break;
+    int k = hash(slot[j]);
+    // the entry at `j' can fill the hole at `i' if `k' is not in (i, j]
+    if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+      slot[i] = slot[j];
+      i = j;
+    }
+  }
+  slot[i] = EMPTY;
+  g_nr_bp --;
+  (*page_cnt(pc)) --;
+  return true;
+}
+
+void bp_foreach(void (*f)(vaddr_t pc)) {
+  if (g_nr_bp == 0) return;
+  for (int i = 0; i < NR_SLOT; i ++) {
+    if (slot[i] != EMPTY) f(slot[i]);
+  }
+}
@@ -16,7 +16,16 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/breakpoint.h>
+#include <device/event.h>
 #include <locale.h>
+#ifndef CONFIG_TARGET_AM
+#include <sys/resource.h>
+#endif
+#ifdef CONFIG_MULTI_HART
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -25,12 +34,26 @@
  */
 #define MAX_INST_TO_PRINT 10
 
-CPU_state cpu = {};
-uint64_t g_nr_guest_inst = 0;
-static uint64_t g_timer = 0; // unit: us
-static bool g_print_step = false;
+HART_LOCAL CPU_state cpu = {};
+HART_LOCAL uint64_t g_nr_guest_inst = 0;
+IFDEF(CONFIG_HPM_EVENTS, HART_LOCAL HPMEvents g_hpm = {});
+static HART_LOCAL uint64_t g_timer = 0; // unit: us
+static HART_LOCAL bool g_print_step = false;
+
+#ifdef CONFIG_MULTI_HART
+// the harts other than hart 0 execute this many instructions at a time
+#define HART_BATCH 100000
+
+HART_LOCAL int g_hartid = 0;
+// g_device_deadline and g_nr_guest_inst of each hart
+static uint64_t *hart_deadline[NR_HARTS] = {};
+static uint64_t *hart_nr_inst[NR_HARTS] = {};
 
-void device_update();
+void hart_wakeup(int hartid) {
+    uint64_t *deadline = __atomic_load_n(&hart_deadline[hartid], __ATOMIC_ACQUIRE);
+    if (deadline != NULL) __atomic_store_n(deadline, 0, __ATOMIC_SEQ_CST);
+}
+#endif
 
 extern void wp_difftest();
 extern void display_inst();
@@ -40,7 +63,12 @@ static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
     if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
 #endif
     if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
-    IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
+#ifdef CONFIG_DIFFTEST
+    // the REF shares the host FPU as well
+    isa_fp_save();
+    difftest_step(_this->pc, dnpc);
+    isa_fp_restore();
+#endif
     IFDEF(CONFIG_WATCHPOINT, wp_difftest());
 }
 
@@ -77,13 +105,48 @@ static void exec_once(Decode *s, vaddr_t pc) {
 
 static void execute(uint64_t n) {
     Decode s;
+    isa_fp_restore();
     for (; n > 0; n--) {
+#ifdef CONFIG_DECODE_CACHE
+        // a pair or a chain of cached instructions may be executed at once,
+        // which counts the instructions before the last step by itself
+        s.budget = (g_nr_bp == 0 ? n : 1);
+        uint64_t nr_inst = g_nr_guest_inst;
+        exec_once(&s, cpu.pc);
+        g_nr_guest_inst += s.ninst;
+        n -= g_nr_guest_inst - nr_inst - 1;
+#else
         exec_once(&s, cpu.pc);
         g_nr_guest_inst++;
+#endif
         trace_and_difftest(&s, cpu.pc);
-        if (nemu_state.state != NEMU_RUNNING) break;  // stop if get some wrong when it  is executing
-        IFDEF(CONFIG_DEVICE, device_update());
+        if (__atomic_load_n(&nemu_state.state, __ATOMIC_RELAXED) != NEMU_RUNNING) break;  // stop if get some wrong when it  is executing
+#ifdef CONFIG_DEVICE
+        if (unlikely(g_nr_guest_inst >= device_deadline())) {
+#ifdef CONFIG_MULTI_HART
+            // the other harts check their interrupts again after hart_wakeup()
+            if (g_hartid != 0) set_device_deadline(UINT64_MAX);
+            else
+#endif
+            {
+                isa_fp_save();
+                device_update();
+                isa_fp_restore();
+            }
+            word_t intr = isa_query_intr();
+            if (intr != INTR_EMPTY) {
+                IFDEF(CONFIG_DIFFTEST, ref_difftest_raise_intr(intr));
+                cpu.pc = isa_raise_intr(intr, cpu.pc);
+            }
+        }
+#endif
+        // stop before executing the instruction at a breakpoint
+        if (unlikely(bp_check(cpu.pc))) {
+            nemu_state.state = NEMU_STOP;
+            break;
+        }
     }
+    isa_fp_save();
 }
 
 static void statistic() {
@@ -91,9 +154,20 @@ static void statistic() {
 #define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%", "%'") PRIu64
     Log("host time spent = " NUMBERIC_FMT " us", g_timer);
     Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
+#ifdef CONFIG_MULTI_HART
+    for (int i = 1; i < NR_HARTS; i++) {
+        uint64_t *nr_inst = __atomic_load_n(&hart_nr_inst[i], __ATOMIC_ACQUIRE);
+        Log("guest instructions of hart %d = " NUMBERIC_FMT, i, nr_inst ? __atomic_load_n(nr_inst, __ATOMIC_RELAXED) : 0);
+    }
+#endif
     if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
     else
         Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+#ifndef CONFIG_TARGET_AM
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    Log("host max RSS = " NUMBERIC_FMT " KB", (uint64_t) usage.ru_maxrss);
+#endif
 }
 
 void assert_fail_msg() {
@@ -102,9 +176,43 @@ void assert_fail_msg() {
     statistic();
 }
 
+#ifdef CONFIG_MULTI_HART
+/* The other harts run on their own threads while hart 0 is running, and
+ * stop once any hart stops the machine. The threads never exit, since
+ * the machine may run again after it stops. */
+static void *hart_main(void *arg) {
+    g_hartid = (intptr_t) arg;
+    isa_init_hart();
+    __atomic_store_n(&hart_nr_inst[g_hartid], &g_nr_guest_inst, __ATOMIC_RELEASE);
+    __atomic_store_n(&hart_deadline[g_hartid], &g_device_deadline, __ATOMIC_RELEASE);
+    while (true) {
+        if (__atomic_load_n(&nemu_state.state, __ATOMIC_RELAXED) != NEMU_RUNNING) {
+            usleep(1000);
+            continue;
+        }
+        execute(HART_BATCH);
+    }
+    return NULL;
+}
+
+static void start_harts() {
+    static bool started = false;
+    if (started) return;
+    started = true;
+    hart_deadline[0] = &g_device_deadline;
+    for (intptr_t i = 1; i < NR_HARTS; i++) {
+        pthread_t t;
+        int ret = pthread_create(&t, NULL, hart_main, (void *) i);
+        Assert(ret == 0, "Can not create the thread of hart %d", (int) i);
+        pthread_detach(t);
+    }
+}
+#endif
+
 /* Simulate how the CPU works. */
-void cpu_exec(uint64_t n) {
-    g_print_step = (n < MAX_INST_TO_PRINT);
+static void cpu_run(uint64_t n, bool print) {
+    IFDEF(CONFIG_MULTI_HART, start_harts());
+    g_print_step = print;
     switch (nemu_state.state) {
         case NEMU_END:
         case NEMU_ABORT:
@@ -121,6 +229,13 @@ void cpu_exec(uint64_t n) {
     uint64_t timer_end = get_time();
     g_timer += timer_end - timer_start;
 
+#ifdef CONFIG_MULTI_HART
+    // another hart may end the machine at the same time
+    int running = NEMU_RUNNING;
+    __atomic_compare_exchange_n(&nemu_state.state, &running, NEMU_STOP, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+
     switch (nemu_state.state) {
         case NEMU_RUNNING:
             nemu_state.state = NEMU_STOP;
@@ -138,3 +253,11 @@ void cpu_exec(uint64_t n) {
             statistic();
     }
 }
+
+void cpu_exec(uint64_t n) {
+    cpu_run(n, n < MAX_INST_TO_PRINT);
+}
+
+void cpu_exec_quiet(uint64_t n) {
+    cpu_run(n, false);
+}
@@ -16,6 +16,7 @@
 #include <common.h>
 #include <utils.h>
 #include <device/alarm.h>
+#include <device/event.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
 #endif
@@ -25,25 +26,27 @@ void init_serial();
 void init_timer();
 void init_vga();
 void init_i8042();
+void init_ipi();
 void init_audio();
 void init_disk();
 void init_sdcard();
 void init_alarm();
 
-void send_key(uint8_t, bool);
-void vga_update_screen();
+#ifdef CONFIG_MULTI_HART
+#include <pthread.h>
 
-void device_update() {
-  static uint64_t last = 0;
-  uint64_t now = get_time();
-  if (now - last < 1000000 / TIMER_HZ) {
-    return;
-  }
-  last = now;
+static pthread_mutex_t device_mutex = PTHREAD_MUTEX_INITIALIZER;
+void device_lock() { pthread_mutex_lock(&device_mutex); }
+void device_unlock() { pthread_mutex_unlock(&device_mutex); }
+#endif
 
-  IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+void send_key(uint8_t, bool);
+void vga_update_screen();
+void serial_flush();
 
-#ifndef CONFIG_TARGET_AM
+#if !defined(CONFIG_TARGET_AM) && !defined(CONFIG_MULTI_INSTANCE)
+// SDL is not available to the machines running on other threads
+static void sdl_poll_event() {
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
     switch (event.type) {
@@ -63,8 +66,8 @@ void device_update() {
       default: break;
     }
   }
-#endif
 }
+#endif
 
 void sdl_clear_event_queue() {
 #ifndef CONFIG_TARGET_AM
@@ -81,9 +84,17 @@ void init_device() {
   IFDEF(CONFIG_HAS_TIMER, init_timer());
   IFDEF(CONFIG_HAS_VGA, init_vga());
   IFDEF(CONFIG_HAS_KEYBOARD, init_i8042());
+  IFDEF(CONFIG_HAS_IPI, init_ipi());
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
+
+  /* Periodic work is driven by device events instead of polling the host
+   * clock after every instruction. */
+  IFDEF(CONFIG_HAS_SERIAL, add_device_event(serial_flush, 1000000 / TIMER_HZ));
+  IFDEF(CONFIG_HAS_VGA, add_device_event(vga_update_screen, 1000000 / TIMER_HZ));
+  IFNDEF(CONFIG_TARGET_AM, IFNDEF(CONFIG_MULTI_INSTANCE,
+        add_device_event(sdl_poll_event, 1000000 / TIMER_HZ)));
 }
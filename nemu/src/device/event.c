@@ -0,0 +1,191 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/event.h>
+#include <device/map.h>
+#include <cpu/cpu.h>
+#include <utils.h>
+#ifndef CONFIG_TARGET_AM
+#include <unistd.h>
+#endif
+
+/* Device events are kept in a min-heap ordered by their deadlines in device
+ * time. Since the execution loop can not afford to read the host clock
+ * after every instruction, the distance to the earliest deadline is
+ * converted to a number of guest instructions with the simulation
+ * frequency measured so far, and the clock is only read again after the
+ * loop has executed that many instructions.
+ *
+ * With CONFIG_VIRTUAL_TIME, device time is a function of the number of
+ * guest instructions, so the conversion is exact and no host clock is read.
+ */
+
+#define MAX_EVENT 8
+// bounds of the distance between two checks (unit: number of instructions)
+#define MIN_CHECK_INST 64
+#define MAX_CHECK_INST (1ull << 22)
+// only trust the frequency measured in a window no longer than this (unit: us)
+#define MAX_RATE_WINDOW 100000
+// time for which a hart other than hart 0 sleeps on wfi (unit: us)
+#define HART_IDLE_US 100
+
+typedef struct {
+  uint64_t deadline; // unit: us
+  uint64_t period;   // unit: us
+  event_handler_t handler;
+} DeviceEvent;
+
+static MACHINE_LOCAL DeviceEvent heap[MAX_EVENT] = {};
+static MACHINE_LOCAL int nr_event = 0;
+
+HART_LOCAL uint64_t g_device_deadline = 0;
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+
+#ifdef CONFIG_VIRTUAL_TIME
+#define IPS CONFIG_VIRTUAL_TIME_IPS
+
+// virtual time skipped by device_skip_idle() (unit: us)
+static MACHINE_LOCAL uint64_t skipped_time = 0;
+
+uint64_t device_time() {
+  uint64_t n = g_nr_guest_inst;
+  return n / IPS * 1000000 + n % IPS * 1000000 / IPS + skipped_time;
+}
+
+// number of instructions to execute until the device time reaches `us' later
+static uint64_t time_to_inst(uint64_t us) {
+  return us / 1000000 * IPS + (us % 1000000 * IPS + 999999) / 1000000;
+}
+#else
+static MACHINE_LOCAL uint64_t last_time = 0, last_inst = 0;
+static MACHINE_LOCAL uint64_t inst_per_ms = 1000; // start with a pessimistic guess
+
+uint64_t device_time() {
+  return get_time();
+}
+#endif
+
+static void heap_swap(int i, int j) {
+  DeviceEvent t = heap[i];
+  heap[i] = heap[j];
+  heap[j] = t;
+}
+
+static void heap_up(int i) {
+  while (i > 0) {
+    int p = (i - 1) / 2;
+    if (heap[p].deadline <= heap[i].deadline) break;
+    heap_swap(p, i);
+    i = p;
+  }
+}
+
+static void heap_down(int i) {
+  while (true) {
+    int l = 2 * i + 1, r = l + 1, min = i;
+    if (l < nr_event && heap[l].deadline < heap[min].deadline) min = l;
+    if (r < nr_event && heap[r].deadline < heap[min].deadline) min = r;
+    if (min == i) break;
+    heap_swap(min, i);
+    i = min;
+  }
+}
+
+void add_device_event(event_handler_t h, uint64_t period_us) {
+  assert(nr_event < MAX_EVENT);
+  assert(period_us > 0);
+  heap[nr_event] = (DeviceEvent) { .deadline = device_time() + period_us,
+    .period = period_us, .handler = h };
+  heap_up(nr_event);
+  nr_event ++;
+  set_device_deadline(0); // recompute the next check
+}
+
+#ifndef CONFIG_VIRTUAL_TIME
+static void update_rate(uint64_t now) {
+  uint64_t dt = now - last_time;
+  if (dt < 1000) return;
+  if (dt <= MAX_RATE_WINDOW) {
+    uint64_t rate = (g_nr_guest_inst - last_inst) * 1000 / dt;
+    inst_per_ms = (inst_per_ms * 3 + rate) / 4;
+    if (inst_per_ms == 0) inst_per_ms = 1;
+  }
+  // a longer window means the machine was stopped (e.g. by sdb), so restart measuring
+  last_time = now;
+  last_inst = g_nr_guest_inst;
+}
+#endif
+
+void device_update() {
+  uint64_t now = device_time();
+  IFNDEF(CONFIG_VIRTUAL_TIME, update_rate(now));
+
+  while (nr_event > 0 && heap[0].deadline <= now) {
+    DeviceEvent *e = &heap[0];
+    e->deadline += e->period;
+    // do not try to catch up with the ticks which are missed
+    if (e->deadline <= now) e->deadline = now + e->period;
+    event_handler_t h = e->handler;
+    heap_down(0);
+    IFDEF(CONFIG_MULTI_HART, device_lock());
+    h();
+    IFDEF(CONFIG_MULTI_HART, device_unlock());
+  }
+
+  uint64_t wait = (nr_event > 0 ? heap[0].deadline - now : MAX_RATE_WINDOW);
+#ifdef CONFIG_VIRTUAL_TIME
+  uint64_t delta = time_to_inst(wait);
+  if (delta == 0) delta = 1;
+#else
+  uint64_t delta = wait * inst_per_ms / 1000;
+  if (delta < MIN_CHECK_INST) delta = MIN_CHECK_INST;
+#endif
+  if (delta > MAX_CHECK_INST) delta = MAX_CHECK_INST;
+  set_device_deadline(g_nr_guest_inst + delta);
+}
+
+void device_idle() {
+#ifdef CONFIG_MULTI_HART
+  // only hart 0 follows the device events, and the other harts are
+  // woken up by interrupts, so just give up the host CPU for a while
+  if (g_hartid != 0) { usleep(HART_IDLE_US); return; }
+#endif
+#ifdef CONFIG_VIRTUAL_TIME
+  device_skip_idle(MAX_RATE_WINDOW);
+#else
+#ifndef CONFIG_TARGET_AM
+  uint64_t now = get_time();
+  if (nr_event > 0 && heap[0].deadline > now) {
+    uint64_t wait = heap[0].deadline - now;
+    usleep(wait < MAX_RATE_WINDOW ? wait : MAX_RATE_WINDOW);
+  }
+#endif
+  set_device_deadline(0);
+#endif
+}
+
+#ifdef CONFIG_VIRTUAL_TIME
+void device_skip_idle(uint64_t max_us) {
+  uint64_t now = device_time();
+  uint64_t skip = max_us;
+  if (nr_event > 0) {
+    if (heap[0].deadline <= now) skip = 0;
+    else if (heap[0].deadline - now < skip) skip = heap[0].deadline - now;
+  }
+  skipped_time += skip;
+  // let the events which are due now be handled after this instruction
+  set_device_deadline(0);
+}
+#endif
@@ -13,7 +13,16 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
-#include <isa.h>
+#include <device/intr.h>
+#include <device/event.h>
+#include <cpu/cpu.h>
 
-void dev_raise_intr() {
+MACHINE_LOCAL uint32_t g_dev_intr = 0;
+
+void dev_raise_intr(int src) {
+  assert(src >= 0 && src < NR_DEV_INTR);
+  // hart 0 may take the interrupts on another thread at the same time
+  __atomic_fetch_or(&g_dev_intr, 1u << src, __ATOMIC_SEQ_CST);
+  // let the execution loop check interrupts after the current instruction
+  MUXDEF(CONFIG_MULTI_HART, hart_wakeup(0), set_device_deadline(0));
 }
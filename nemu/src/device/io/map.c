@@ -20,8 +20,8 @@
 
 #define IO_SPACE_MAX (2 * 1024 * 1024)
 
-static uint8_t *io_space = NULL;
-static uint8_t *p_space = NULL;
+static MACHINE_LOCAL uint8_t *io_space = NULL;
+static MACHINE_LOCAL uint8_t *p_space = NULL;
 
 uint8_t* new_space(int size) {
   uint8_t *p = p_space;
@@ -43,7 +43,11 @@ static void check_bound(IOMap *map, paddr_t addr) {
 }
 
 static void invoke_callback(io_callback_t c, paddr_t offset, int len, bool is_write) {
-  if (c != NULL) { c(offset, len, is_write); }
+  if (c != NULL) {
+    isa_fp_save();
+    c(offset, len, is_write);
+    isa_fp_restore();
+  }
 }
 
 void init_map() {
@@ -52,6 +56,13 @@ void init_map() {
   p_space = io_space;
 }
 
+#ifdef CONFIG_MULTI_INSTANCE
+void free_map() {
+  free(io_space);
+  io_space = p_space = NULL;
+}
+#endif
+
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
@@ -15,11 +15,12 @@
 
 #include <device/map.h>
 #include <memory/paddr.h>
+#include <cpu/cpu.h>
 
 #define NR_MAP 16
 
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+static MACHINE_LOCAL IOMap maps[NR_MAP] = {};
+static MACHINE_LOCAL int nr_map = 0;
 
 static IOMap* fetch_mmio_map(paddr_t addr) {
   int mapid = find_mapid_by_addr(maps, nr_map, addr);
@@ -55,9 +56,16 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
 
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  HPM_COUNT(mmio);
+  IFDEF(CONFIG_MULTI_HART, device_lock());
+  word_t ret = map_read(addr, len, fetch_mmio_map(addr));
+  IFDEF(CONFIG_MULTI_HART, device_unlock());
+  return ret;
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
+  HPM_COUNT(mmio);
+  IFDEF(CONFIG_MULTI_HART, device_lock());
   map_write(addr, len, data, fetch_mmio_map(addr));
+  IFDEF(CONFIG_MULTI_HART, device_unlock());
 }
@@ -0,0 +1,47 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <device/intr.h>
+#include <device/event.h>
+#include <cpu/cpu.h>
+
+/* The first register tells the number of harts, and the register at
+ * 4 * (i + 1) is the pending bit of the software interrupt of hart i,
+ * which the guest sets to interrupt hart i and clears in the handler.
+ */
+#define IPI_SIZE (4 * (NR_HARTS + 1))
+
+static MACHINE_LOCAL uint32_t *ipi_base = NULL;
+
+static void ipi_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) return;
+  Assert(offset >= 4 && offset % 4 == 0 && len == 4, "only the pending bits of harts are writable");
+  int hartid = offset / 4 - 1;
+  ipi_base[hartid + 1] &= 1;
+  if (ipi_base[hartid + 1]) MUXDEF(CONFIG_MULTI_HART, hart_wakeup(hartid), set_device_deadline(0));
+}
+
+bool dev_ipi_pending(int hartid) {
+  // read without the device lock by the hart which is interrupted
+  return __atomic_load_n(&ipi_base[hartid + 1], __ATOMIC_SEQ_CST) & 1;
+}
+
+void init_ipi() {
+  ipi_base = (uint32_t *)new_space(IPI_SIZE);
+  memset(ipi_base, 0, IPI_SIZE);
+  ipi_base[0] = NR_HARTS;
+  add_mmio_map("ipi", CONFIG_IPI_MMIO, ipi_base, IPI_SIZE, ipi_io_handler);
+}
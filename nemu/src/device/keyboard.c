@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/intr.h>
 #include <utils.h>
 
 #define KEYDOWN_MASK 0x8000
@@ -39,55 +40,83 @@ enum {
 };
 
 #define SDL_KEYMAP(k) keymap[SDL_SCANCODE_ ## k] = NEMU_KEY_ ## k;
-static uint32_t keymap[256] = {};
+static MACHINE_LOCAL uint32_t keymap[256] = {};
 
 static void init_keymap() {
   MAP(NEMU_KEYS, SDL_KEYMAP)
 }
+#else // !CONFIG_TARGET_AM
+#define NEMU_KEY_NONE 0
+#endif
+
+/* The key queue lives in the space of the key ring, which the guest can
+ * map to drain many keys at once: it reads the entries between `tail' and
+ * `head' directly and then writes the new `tail' back. The i8042 data
+ * port still pops one key per read from the same queue.
+ */
+#define KEY_RING_LEN 256
+enum { reg_head, reg_tail, reg_len, nr_reg };
 
-#define KEY_QUEUE_LEN 1024
-static int key_queue[KEY_QUEUE_LEN] = {};
-static int key_f = 0, key_r = 0;
+static MACHINE_LOCAL uint32_t *key_ring = NULL;
+#define ring_entry(i) key_ring[nr_reg + (i)]
 
 static void key_enqueue(uint32_t am_scancode) {
-  key_queue[key_r] = am_scancode;
-  key_r = (key_r + 1) % KEY_QUEUE_LEN;
-  Assert(key_r != key_f, "key queue overflow!");
+  uint32_t head = key_ring[reg_head];
+  uint32_t next = (head + 1) % KEY_RING_LEN;
+  // drop the key if the guest does not drain the queue
+  if (next == key_ring[reg_tail]) return;
+  ring_entry(head) = am_scancode;
+  key_ring[reg_head] = next;
+  dev_raise_intr(DEV_INTR_EXTERNAL);
 }
 
 static uint32_t key_dequeue() {
   uint32_t key = NEMU_KEY_NONE;
-  if (key_f != key_r) {
-    key = key_queue[key_f];
-    key_f = (key_f + 1) % KEY_QUEUE_LEN;
+  uint32_t tail = key_ring[reg_tail];
+  if (tail != key_ring[reg_head]) {
+    key = ring_entry(tail);
+    key_ring[reg_tail] = (tail + 1) % KEY_RING_LEN;
   }
   return key;
 }
 
+#ifdef CONFIG_TARGET_AM
+// move the keys from the keyboard of the host AM to the queue
+static void key_poll() {
+  while ((key_ring[reg_head] + 1) % KEY_RING_LEN != key_ring[reg_tail]) {
+    AM_INPUT_KEYBRD_T ev = io_read(AM_INPUT_KEYBRD);
+    if (ev.keycode == NEMU_KEY_NONE) break;
+    key_enqueue(ev.keycode | (ev.keydown ? KEYDOWN_MASK : 0));
+  }
+}
+#else
 void send_key(uint8_t scancode, bool is_keydown) {
   if (nemu_state.state == NEMU_RUNNING && keymap[scancode] != NEMU_KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
     key_enqueue(am_scancode);
   }
 }
-#else // !CONFIG_TARGET_AM
-#define NEMU_KEY_NONE 0
-
-static uint32_t key_dequeue() {
-  AM_INPUT_KEYBRD_T ev = io_read(AM_INPUT_KEYBRD);
-  uint32_t am_scancode = ev.keycode | (ev.keydown ? KEYDOWN_MASK : 0);
-  return am_scancode;
-}
 #endif
 
-static uint32_t *i8042_data_port_base = NULL;
+static MACHINE_LOCAL uint32_t *i8042_data_port_base = NULL;
 
 static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
+  IFDEF(CONFIG_TARGET_AM, key_poll());
   i8042_data_port_base[0] = key_dequeue();
 }
 
+static void i8042_ring_io_handler(uint32_t offset, int len, bool is_write) {
+  if (is_write) {
+    Assert(offset == reg_tail * 4 && len == 4, "only tail of the key ring is writable");
+    Assert(key_ring[reg_tail] < KEY_RING_LEN, "invalid tail of the key ring: %d", key_ring[reg_tail]);
+  }
+#ifdef CONFIG_TARGET_AM
+  else if (offset == reg_head * 4) key_poll();
+#endif
+}
+
 void init_i8042() {
   i8042_data_port_base = (uint32_t *)new_space(4);
   i8042_data_port_base[0] = NEMU_KEY_NONE;
@@ -96,5 +125,10 @@ void init_i8042() {
 #else
   add_mmio_map("keyboard", CONFIG_I8042_DATA_MMIO, i8042_data_port_base, 4, i8042_data_io_handler);
 #endif
+  key_ring = (uint32_t *)new_space((nr_reg + KEY_RING_LEN) * sizeof(uint32_t));
+  key_ring[reg_head] = key_ring[reg_tail] = 0;
+  key_ring[reg_len] = KEY_RING_LEN;
+  add_mmio_map("keyring", CONFIG_I8042_RING_MMIO, key_ring,
+      (nr_reg + KEY_RING_LEN) * sizeof(uint32_t), i8042_ring_io_handler);
   IFNDEF(CONFIG_TARGET_AM, init_keymap());
 }
@@ -40,13 +40,13 @@ enum {
   SDHBLC
 };
 
-static FILE *fp = NULL;
-static uint32_t *base = NULL;
-static uint32_t blkcnt = 0;
-static long blk_addr = 0;
-static uint32_t addr = 0;
-static bool write_cmd = 0;
-static bool read_ext_csd = false;
+static MACHINE_LOCAL FILE *fp = NULL;
+static MACHINE_LOCAL uint32_t *base = NULL;
+static MACHINE_LOCAL uint32_t blkcnt = 0;
+static MACHINE_LOCAL long blk_addr = 0;
+static MACHINE_LOCAL uint32_t addr = 0;
+static MACHINE_LOCAL bool write_cmd = 0;
+static MACHINE_LOCAL bool read_ext_csd = false;
 
 static void prepare_rw(int is_write) {
   blk_addr = base[SDARG];
@@ -15,37 +15,88 @@
 
 #include <utils.h>
 #include <device/map.h>
+#include <memory/paddr.h>
+#ifndef CONFIG_TARGET_AM
+#include <unistd.h>
+#endif
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 // NOTE: this is compatible to 16550
 
 #define CH_OFFSET 0
+// bulk write path: the guest stores the physical address of a buffer to
+// TX_ADDR, then rings the doorbell by storing the number of bytes to TX_LEN
+#define TX_ADDR_OFFSET 4
+#define TX_LEN_OFFSET  8
+
+#define SERIAL_SPACE_SIZE 16
+#define TX_FIFO_SIZE 4096
+
+static MACHINE_LOCAL uint8_t *serial_base = NULL;
+
+// bytes written through CH_OFFSET are collected here and sent to the host
+// with a single write(2), instead of one stdio call per byte
+static MACHINE_LOCAL char tx_fifo[TX_FIFO_SIZE] = {};
+static MACHINE_LOCAL int tx_fifo_len = 0;
 
-static uint8_t *serial_base = NULL;
+static void serial_write_host(const char *buf, size_t len) {
+#ifdef CONFIG_TARGET_AM
+  for (size_t i = 0; i < len; i ++) putch(buf[i]);
+#else
+  while (len > 0) {
+    ssize_t ret = write(STDERR_FILENO, buf, len);
+    if (ret <= 0) break;
+    buf += ret;
+    len -= ret;
+  }
+#endif
+}
 
+void serial_flush() {
+  if (tx_fifo_len > 0) {
+    serial_write_host(tx_fifo, tx_fifo_len);
+    tx_fifo_len = 0;
+  }
+}
 
 static void serial_putc(char ch) {
-  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
+  tx_fifo[tx_fifo_len ++] = ch;
+  if (ch == '\n' || tx_fifo_len == TX_FIFO_SIZE) serial_flush();
+}
+
+static void serial_tx_bulk(paddr_t addr, uint32_t len) {
+  if (len == 0) return;
+  Assert(in_pmem_range(addr, len),
+      "serial bulk write [" FMT_PADDR ", " FMT_PADDR ") is out of pmem", addr, addr + len);
+  // keep the order with the bytes already in the FIFO
+  serial_flush();
+  serial_write_host((char *)guest_to_host(addr), len);
 }
 
 static void serial_io_handler(uint32_t offset, int len, bool is_write) {
-  assert(len == 1);
   switch (offset) {
     /* We bind the serial port with the host stderr in NEMU. */
     case CH_OFFSET:
+      assert(len == 1);
       if (is_write) serial_putc(serial_base[0]);
       else panic("do not support read");
       break;
+    case TX_ADDR_OFFSET: break;
+    case TX_LEN_OFFSET:
+      assert(len == 4);
+      if (is_write) serial_tx_bulk(*(uint32_t *)(serial_base + TX_ADDR_OFFSET),
+                                   *(uint32_t *)(serial_base + TX_LEN_OFFSET));
+      break;
     default: panic("do not support offset = %d", offset);
   }
 }
 
 void init_serial() {
-  serial_base = new_space(8);
+  serial_base = new_space(SERIAL_SPACE_SIZE);
 #ifdef CONFIG_HAS_PORT_IO
-  add_pio_map ("serial", CONFIG_SERIAL_PORT, serial_base, 8, serial_io_handler);
+  add_pio_map ("serial", CONFIG_SERIAL_PORT, serial_base, SERIAL_SPACE_SIZE, serial_io_handler);
 #else
-  add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, 8, serial_io_handler);
+  add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, SERIAL_SPACE_SIZE, serial_io_handler);
 #endif
-
+  IFNDEF(CONFIG_TARGET_AM, IFNDEF(CONFIG_MULTI_INSTANCE, atexit(serial_flush)));
 }
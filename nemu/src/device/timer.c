@@ -15,14 +15,39 @@
 
 #include <device/map.h>
 #include <device/alarm.h>
+#include <device/event.h>
+#include <device/intr.h>
 #include <utils.h>
 
-static uint32_t *rtc_port_base = NULL;
+static MACHINE_LOCAL uint32_t *rtc_port_base = NULL;
+
+#ifdef CONFIG_VIRTUAL_TIME_IDLE_SKIP
+// a guest reading the rtc this often is considered to be busy-waiting
+#define IDLE_READ_INST 64
+#define IDLE_READ_COUNT 16
+#define IDLE_SKIP_US 1000
+
+// A guest spinning on the rtc only makes progress when time goes by, so
+// let the virtual clock jump forward instead of executing the loop.
+static void detect_idle() {
+  extern HART_LOCAL uint64_t g_nr_guest_inst;
+  static MACHINE_LOCAL uint64_t last_read = 0;
+  static MACHINE_LOCAL int nr_close_read = 0;
+  if (g_nr_guest_inst - last_read <= IDLE_READ_INST) {
+    if (++ nr_close_read >= IDLE_READ_COUNT) {
+      device_skip_idle(IDLE_SKIP_US);
+      nr_close_read = 0;
+    }
+  } else nr_close_read = 0;
+  last_read = g_nr_guest_inst;
+}
+#endif
 
 static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0 || offset == 4);
   if (!is_write && offset == 4) {
-    uint64_t us = get_time();
+    IFDEF(CONFIG_VIRTUAL_TIME_IDLE_SKIP, detect_idle());
+    uint64_t us = device_time();
     rtc_port_base[0] = (uint32_t)us;
     rtc_port_base[1] = us >> 32;
   }
@@ -31,8 +56,7 @@ static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
 #ifndef CONFIG_TARGET_AM
 static void timer_intr() {
   if (nemu_state.state == NEMU_RUNNING) {
-    extern void dev_raise_intr();
-    dev_raise_intr();
+    dev_raise_intr(DEV_INTR_TIMER);
   }
 }
 #endif
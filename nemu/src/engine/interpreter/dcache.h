@@ -0,0 +1,213 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __ENGINE_DCACHE_H__
+#define __ENGINE_DCACHE_H__
+
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/ifetch.h>
+#include <memory/vaddr.h>
+#include <memory/paddr.h>
+#ifdef CONFIG_DEVICE
+#include <device/event.h>
+#endif
+
+/* The decode and execute skeleton shared by the ISAs. An ISA provides
+ *   - R(i), the general purpose register i, where R(0) reads as zero;
+ *   - decode_operand(s, &rd, &rs1, &rs2, &imm, type), which extracts the
+ *     operands of an instruction format, with 0 for a source register
+ *     not used by the format;
+ *   - decode_exec(), which begins with DECODE_EXEC_BEGIN(s), matches the
+ *     patterns between INSTPAT_START() and INSTPAT_END(), and ends with
+ *     DECODE_EXEC_END(s).
+ *
+ * With CONFIG_DECODE_CACHE, an entry keeps the operands and the label of
+ * the body of an instruction, and is used when the same instruction is
+ * fetched from the same PC again. An ISA may define before including
+ * this file
+ *   - DCACHE_PC_SHIFT, log2 of the length of the shortest instruction;
+ *   - DCACHE_ENTRY_EXT, more members of an entry;
+ *   - DCACHE_FILL_HOOK(s, e), to update them after an entry is filled;
+ *   - DCACHE_HIT_HOOK(s, e), to run before the body on a hit. It may
+ *     `goto decode_exec_end' if the instruction is done;
+ *   - DCACHE_FETCH(snpc), to fetch the instruction at *snpc in the form
+ *     decoded for CONFIG_BLOCK_CHAIN, 4 bytes by default.
+ */
+
+// the accesses of a width known when the instruction is decoded
+#define Mr(addr, bits) (HPM_COUNT(load), concat(vaddr_read, bits)(addr))
+#define Mw(addr, bits, data) (HPM_COUNT(store), concat(vaddr_write, bits)(addr, data))
+
+#ifdef CONFIG_DECODE_CACHE
+#ifndef DCACHE_PC_SHIFT
+#define DCACHE_PC_SHIFT 2
+#endif
+#ifndef DCACHE_ENTRY_EXT
+#define DCACHE_ENTRY_EXT
+#endif
+#ifndef DCACHE_FILL_HOOK
+#define DCACHE_FILL_HOOK(s, e)
+#endif
+#ifndef DCACHE_HIT_HOOK
+#define DCACHE_HIT_HOOK(s, e)
+#endif
+#ifndef DCACHE_FETCH
+#define DCACHE_FETCH(snpc) inst_fetch(snpc, 4)
+#endif
+
+typedef struct DecodeEntry {
+  vaddr_t pc;
+  uint32_t inst;    // the instruction decoded
+  uint8_t rd, rs1, rs2;
+  uint8_t len;      // the length in memory
+  word_t imm;
+  const void *exec; // the label of the body
+#ifdef CONFIG_BLOCK_CHAIN
+  // the instructions executed after this one, at snpc and elsewhere
+  struct DecodeEntry *next, *taken;
+#endif
+  DCACHE_ENTRY_EXT
+} DecodeEntry;
+
+#define DCACHE_SIZE 4096
+static HART_LOCAL DecodeEntry dcache[DCACHE_SIZE];
+
+static inline DecodeEntry *dcache_entry(vaddr_t pc) {
+  return &dcache[(pc >> DCACHE_PC_SHIFT) % DCACHE_SIZE];
+}
+
+// never the PC of an instruction
+#define DCACHE_INVALID_PC 1
+
+static inline void dcache_fill(Decode *s, DecodeEntry *e, const void *exec,
+    int rd, int rs1, int rs2, word_t imm) {
+  e->pc = s->pc;
+  e->inst = s->isa.inst.val;
+  e->rd = rd;
+  e->rs1 = rs1;
+  e->rs2 = rs2;
+  e->len = s->snpc - s->pc;
+  e->imm = imm;
+  e->exec = exec;
+  IFDEF(CONFIG_BLOCK_CHAIN, e->next = e->taken = NULL);
+#ifdef CONFIG_SMC_DETECT
+  // only the instructions in pmem are known to be written
+  if (!in_pmem_range(s->pc, e->len)) {
+    e->pc = DCACHE_INVALID_PC;
+    return;
+  }
+  pmem_code_mark(s->pc);
+  pmem_code_mark(s->pc + e->len - 1);
+#endif
+}
+
+#ifdef CONFIG_SMC_DETECT
+/* Drop the entries of the instructions in the page at `page', which is
+ * written. It is called by pmem_code_written(), and defined here since
+ * the entries are private to the ISA including this file.
+ */
+void dcache_invalidate(paddr_t page) {
+  for (vaddr_t pc = page; pc - page < PMEM_PAGE_SIZE; pc += 1 << DCACHE_PC_SHIFT) {
+    DecodeEntry *e = dcache_entry(pc);
+    if (e->pc == pc) e->pc = DCACHE_INVALID_PC;
+  }
+  // an instruction crossing into the page starts in the one before
+  DecodeEntry *e = dcache_entry(page - 2);
+  if (e->pc == page - 2 && e->len > 2) e->pc = DCACHE_INVALID_PC;
+}
+#endif
+
+#define DCACHE_EXEC(s, e) { \
+  DCACHE_HIT_HOOK(s, e); \
+  rd = e->rd; rs1 = e->rs1; rs2 = e->rs2; imm = e->imm; \
+  goto *e->exec; \
+}
+
+#define DCACHE_LOOKUP(s) \
+  DecodeEntry *e = dcache_entry(s->pc); \
+  if (likely(e->pc == s->pc && e->inst == s->isa.inst.val)) DCACHE_EXEC(s, e)
+#endif
+
+#ifdef CONFIG_BLOCK_CHAIN
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+
+/* Move on to the entry of the next instruction if execute() has nothing
+ * to do before it. The link followed is patched when it is stale, so
+ * `taken' keeps the last target of a jump through a register. Without
+ * CONFIG_SMC_DETECT, the entry is still checked against the instruction
+ * fetched. The instructions executed so far are counted, as if execute()
+ * did so.
+ */
+static inline bool chain_next(Decode *s, DecodeEntry **pe) {
+  if (s->budget <= s->ninst ||
+      __atomic_load_n(&nemu_state.state, __ATOMIC_RELAXED) != NEMU_RUNNING) return false;
+  // written by the other harts or the devices
+  IFDEF(CONFIG_DEVICE, if (g_nr_guest_inst + s->ninst >= device_deadline()) return false);
+  vaddr_t pc = s->dnpc;
+  DecodeEntry **link = (pc == s->snpc ? &(*pe)->next : &(*pe)->taken);
+  DecodeEntry *e = *link;
+  if (unlikely(e == NULL || e->pc != pc)) {
+    e = dcache_entry(pc);
+    if (e->pc != pc) return false;
+    *link = e;
+  }
+#ifdef CONFIG_SMC_DETECT
+  // the entry is dropped once its instruction is written
+  vaddr_t snpc = pc + e->len;
+  uint32_t inst = e->inst;
+#else
+  vaddr_t snpc = pc;
+  uint32_t inst = DCACHE_FETCH(&snpc);
+  if (unlikely(inst != e->inst)) return false;
+#endif
+
+  g_nr_guest_inst += s->ninst;
+  s->budget -= s->ninst;
+  s->ninst = 1;
+  s->pc = cpu.pc = pc;
+  s->snpc = s->dnpc = snpc;
+  s->isa.inst.val = inst;
+  *pe = e;
+  return true;
+}
+#endif
+
+#define DECODE_EXEC_BEGIN(s) \
+  int rd = 0, rs1 = 0, rs2 = 0; \
+  /* an ISA may not use all of them */ \
+  __attribute__((unused)) word_t src1 = 0, src2 = 0, imm = 0; \
+  s->dnpc = s->snpc; \
+  IFDEF(CONFIG_DECODE_CACHE, s->ninst = 1); \
+  IFDEF(CONFIG_DECODE_CACHE, DCACHE_LOOKUP(s))
+
+#define DECODE_EXEC_END(s) \
+  decode_exec_end: __attribute__((unused)); \
+  R(0) = 0; /* reset $zero to 0 */ \
+  IFDEF(CONFIG_BLOCK_CHAIN, if (chain_next(s, &e)) DCACHE_EXEC(s, e)) \
+  return 0;
+
+// Both macros are used by the INSTPAT() defined in decode.h
+#define INSTPAT_INST(s) ((s)->isa.inst.val)
+#define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
+  decode_operand(s, &rd, &rs1, &rs2, &imm, concat(TYPE_, type)); \
+  IFDEF(CONFIG_DECODE_CACHE, dcache_fill(s, e, &&concat(exec_, name), rd, rs1, rs2, imm); \
+      DCACHE_FILL_HOOK(s, e); concat(exec_, name):) \
+  src1 = R(rs1); \
+  src2 = R(rs2); \
+  __VA_ARGS__ ; \
+}
+
+#endif
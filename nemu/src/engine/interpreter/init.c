@@ -21,6 +21,11 @@ void engine_start() {
 #ifdef CONFIG_TARGET_AM
   cpu_exec(-1);
 #else
+#ifdef CONFIG_MULTI_INSTANCE
+  /* Run the images given by --multi, if any. */
+  bool multi_mainloop();
+  if (multi_mainloop()) return;
+#endif
   /* Receive commands from user. */
   sdb_mainloop();
 #endif
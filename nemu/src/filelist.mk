@@ -16,10 +16,12 @@
 SRCS-y += src/nemu-main.c
 DIRS-y += src/cpu src/monitor src/utils
 DIRS-$(CONFIG_MODE_SYSTEM) += src/memory
-DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
+DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb src/monitor/gdb
+SRCS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/image.c
 
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
-LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
+LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -lpthread -pie,)
+LIBS += $(if $(CONFIG_TARGET_AM),,-lz)
 
 ifdef mainargs
 ASFLAGS += -DBIN_PATH=\"$(mainargs)\"
@@ -15,3 +15,10 @@
 
 INC_PATH += $(NEMU_HOME)/src/isa/$(GUEST_ISA)/include
 DIRS-y += src/isa/$(GUEST_ISA)
+
+# the F and D extensions of riscv32 change the rounding mode of the host FPU,
+# and are executed only by the code in inst.c
+ifdef CONFIG_RV_FD
+%/src/isa/riscv32/inst.o: CFLAGS += -frounding-math
+endif
+LIBS += $(if $(CONFIG_RV_FD),-lm,)
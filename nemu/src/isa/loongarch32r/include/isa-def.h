@@ -31,5 +31,7 @@ typedef struct {
 } loongarch32r_ISADecodeInfo;
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#define isa_fp_save()
+#define isa_fp_restore()
 
 #endif
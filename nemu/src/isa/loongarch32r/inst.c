@@ -14,24 +14,21 @@
 ***************************************************************************************/
 
 #include "local-include/reg.h"
-#include <cpu/cpu.h>
 #include <cpu/ifetch.h>
-#include <cpu/decode.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
+#include <dcache.h>
 
 enum {
   TYPE_2RI12, TYPE_1RI20,
   TYPE_N, // none
 };
 
-#define src1R()  do { *src1 = R(rj); } while (0)
+#define src1R()  do { *rs1 = rj; } while (0)
 #define simm12() do { *imm = SEXT(BITS(i, 21, 10), 12); } while (0)
 #define simm20() do { *imm = SEXT(BITS(i, 24, 5), 20) << 12; } while (0)
 
-static void decode_operand(Decode *s, int *rd_, word_t *src1, word_t *src2, word_t *imm, int type) {
+static void decode_operand(Decode *s, int *rd_, int *rs1, int *rs2, word_t *imm, int type) {
   uint32_t i = s->isa.inst.val;
   int rj = BITS(i, 9, 5);
   *rd_ = BITS(i, 4, 0);
@@ -42,28 +39,18 @@ static void decode_operand(Decode *s, int *rd_, word_t *src1, word_t *src2, word
 }
 
 static int decode_exec(Decode *s) {
-  int rd = 0;
-  word_t src1 = 0, src2 = 0, imm = 0;
-  s->dnpc = s->snpc;
-
-#define INSTPAT_INST(s) ((s)->isa.inst.val)
-#define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
-  decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
-  __VA_ARGS__ ; \
-}
+  DECODE_EXEC_BEGIN(s);
 
   INSTPAT_START();
   INSTPAT("0001110 ????? ????? ????? ????? ?????" , pcaddu12i, 1RI20 , R(rd) = s->pc + imm);
-  INSTPAT("0010100010 ???????????? ????? ?????"   , ld.w     , 2RI12 , R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("0010100110 ???????????? ????? ?????"   , st.w     , 2RI12 , Mw(src1 + imm, 4, R(rd)));
+  INSTPAT("0010100010 ???????????? ????? ?????"   , ld_w     , 2RI12 , R(rd) = Mr(src1 + imm, 32));
+  INSTPAT("0010100110 ???????????? ????? ?????"   , st_w     , 2RI12 , Mw(src1 + imm, 32, R(rd)));
 
   INSTPAT("0000 0000 0010 10100 ????? ????? ?????", break    , N     , NEMUTRAP(s->pc, R(4))); // R(4) is $a0
   INSTPAT("????????????????? ????? ????? ?????"   , inv      , N     , INV(s->pc));
   INSTPAT_END();
 
-  R(0) = 0; // reset $zero to 0
-
-  return 0;
+  DECODE_EXEC_END(s);
 }
 
 int isa_exec_once(Decode *s) {
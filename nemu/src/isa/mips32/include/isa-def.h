@@ -32,5 +32,7 @@ typedef struct {
 } mips32_ISADecodeInfo;
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#define isa_fp_save()
+#define isa_fp_restore()
 
 #endif
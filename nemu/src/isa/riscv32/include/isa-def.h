@@ -24,12 +24,22 @@ typedef struct {
     word_t mepc;
     word_t mstatus;
     word_t mtvec;
+    word_t mie;
+    word_t mip;
+    word_t mhartid;
+    uint64_t counter_offset[32]; // added to the counters after they are written
+#ifdef CONFIG_RV_FD
+    word_t fcsr;
+#endif
 } riscv32_CSRs;
 
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
   riscv32_CSRs csr;
+#ifdef CONFIG_RV_FD
+  uint64_t fpr[32]; // a single is NaN-boxed
+#endif
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
@@ -40,5 +50,9 @@ typedef struct {
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#ifndef CONFIG_RV_FD
+#define isa_fp_save()
+#define isa_fp_restore()
+#endif
 
 #endif
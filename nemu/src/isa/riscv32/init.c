@@ -14,7 +14,11 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/paddr.h>
+#ifdef CONFIG_RV_FD
+#include <fenv.h>
+#endif
 
 // this is not consistent with uint8_t
 // but it is ok since we do not access the array directly
@@ -36,9 +40,26 @@ static void restart() {
 
   /* For riscv32, init the 'mstatus' 0x1800 */
   cpu.csr.mstatus = 0x1800;
+
+  cpu.csr.mhartid = g_hartid;
+
+#ifdef CONFIG_RV_FD
+  /* The host FPU of this hart rounds to nearest without flags. */
+  fesetround(FE_TONEAREST);
+  feclearexcept(FE_ALL_EXCEPT);
+#endif
+}
+
+#ifdef CONFIG_MULTI_HART
+void isa_init_hart() {
+  /* All harts start from the reset vector. */
+  restart();
 }
+#endif
 
 void init_isa() {
+  IFDEF(CONFIG_RVC, void init_rvc(); init_rvc());
+
   /* Load built-in image. */
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
 
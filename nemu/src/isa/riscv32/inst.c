@@ -16,15 +16,43 @@
 #include "local-include/reg.h"
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
-#include <cpu/decode.h>
+#include <memory/paddr.h>
+#include <stddef.h>
+#ifdef CONFIG_RV_FD
+#include "local-include/fpu.h"
+#endif
+#ifdef CONFIG_DEVICE
+#include <device/event.h>
+#endif
 
 extern void display_call_func(word_t pc, word_t func_addr);
 extern void display_ret_func(word_t pc);
-
+extern HART_LOCAL uint64_t g_nr_guest_inst;
+IFDEF(CONFIG_RVC, extern uint32_t rvc_table[]);
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
+#define DCACHE_PC_SHIFT MUXDEF(CONFIG_RVC, 1, 2)
+#ifdef CONFIG_INST_FUSION
+// the pair starting with an instruction
+#define DCACHE_ENTRY_EXT \
+    uint8_t fuse, frs, frd, brs1, brs2, bop, len2; \
+    uint32_t raw2;    /* the second instruction in memory */ \
+    word_t fimm, ftarget, fnext;
+#define DCACHE_FILL_HOOK(s, e) fuse_check(s, e)
+#define DCACHE_HIT_HOOK(s, e) if (e->fuse != FUSE_NONE && s->budget > 1 && fuse_exec(s, e)) goto decode_exec_end
+#endif
+#ifdef CONFIG_RVC
+// the instruction at *snpc, expanded if it is compressed
+static inline uint32_t inst_fetch_expand(vaddr_t *snpc) {
+    uint32_t inst = inst_fetch(snpc, 2);
+    if ((inst & 0x3) != 0x3) return rvc_table[inst];
+    return inst | (inst_fetch(snpc, 2) << 16);
+}
+#define DCACHE_FETCH(snpc) inst_fetch_expand(snpc)
+#endif
+#include <dcache.h>
+
+
 
 enum {
     TYPE_I, TYPE_U, TYPE_S, TYPE_R,
@@ -32,8 +60,8 @@ enum {
     TYPE_N, // none
 };
 
-#define src1R() do { *src1 = R(rs1); } while (0)
-#define src2R() do { *src2 = R(rs2); } while (0)
+#define src1R() do { *rs1 = BITS(i, 19, 15); } while (0)
+#define src2R() do { *rs2 = BITS(i, 24, 20); } while (0)
 
 /*
  * There is a point that is easily overlooked here.
@@ -53,10 +81,8 @@ enum {
                           BITS(i, 30, 21) << 1; } while(0)
 
 
-static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_t *imm, int type) {
+static void decode_operand(Decode *s, int *rd, int *rs1, int *rs2, word_t *imm, int type) {
     uint32_t i = s->isa.inst.val;
-    int rs1 = BITS(i, 19, 15);
-    int rs2 = BITS(i, 24, 20);
     *rd = BITS(i, 11, 7);
     switch (type) {
         case TYPE_R:
@@ -90,26 +116,113 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
     }
 }
 
-// for 'trap'
-static vaddr_t *csr_register(word_t imm) {
-    switch (imm) {
-        case 0x341:
-            return &(cpu.csr.mepc);
-        case 0x342:
-            return &(cpu.csr.mcause);
-        case 0x300:
-            return &(cpu.csr.mstatus);
-        case 0x305:
-            return &(cpu.csr.mtvec);
-        default:
-            panic("Unknown csr");
-    }
-}
-
 //
 // this part below is for TRAP and CSR.
 //
 
+// interrupts may become deliverable after mstatus, mie or mip is written,
+// so ask the execution loop to check them after this instruction
+static inline void csr_updated() {
+    IFDEF(CONFIG_DEVICE, set_device_deadline(0));
+}
+
+// the offsets in CPU_state of the CSRs simply kept there, 0 for the others
+#define CSR_OFFSET(name) offsetof(CPU_state, csr.name)
+static const uint16_t csr_offset[4096] = {
+    [CSR_MSTATUS] = CSR_OFFSET(mstatus), [CSR_MIE] = CSR_OFFSET(mie),
+    [CSR_MTVEC] = CSR_OFFSET(mtvec), [CSR_MEPC] = CSR_OFFSET(mepc),
+    [CSR_MCAUSE] = CSR_OFFSET(mcause), [CSR_MIP] = CSR_OFFSET(mip),
+    [CSR_MHARTID] = CSR_OFFSET(mhartid),
+};
+#define CSR_PLAIN(addr) (*(word_t *) ((uint8_t *) &cpu + csr_offset[addr]))
+
+// the cycles are the instructions, since NEMU does not model the timing
+static uint64_t counter_event(int idx) {
+    switch (idx) {
+        case 0: case 2: return g_nr_guest_inst;
+        case COUNTER_TIME: return MUXDEF(CONFIG_DEVICE, device_time(), get_time());
+#ifdef CONFIG_RV_HPM
+        case 3: return g_hpm.load;
+        case 4: return g_hpm.store;
+        case 5: return g_hpm.branch;
+        case 6: return g_hpm.mmio;
+        case 7: return g_hpm.trap;
+#endif
+        default: return 0;
+    }
+}
+
+static inline uint64_t counter(int idx) {
+    return counter_event(idx) + cpu.csr.counter_offset[idx];
+}
+
+static void counter_write(int idx, bool high, word_t val) {
+    uint64_t old = counter(idx);
+    uint64_t new_val = (high ? ((uint64_t) val << 32) | (uint32_t) old : (old & ~0xffffffffull) | val);
+    cpu.csr.counter_offset[idx] = new_val - counter_event(idx);
+}
+
+static void csr_unknown(int addr) {
+    panic("unknown csr %#x at pc = " FMT_WORD, addr, cpu.pc);
+}
+
+static word_t csr_read(word_t imm) {
+    int addr = imm & 0xfff; // the immediate is sign-extended
+    if (likely(csr_offset[addr] != 0)) return CSR_PLAIN(addr);
+    switch (addr) {
+#ifdef CONFIG_RV_FD
+        // fflags and frm are the fields of fcsr
+        case CSR_FFLAGS: fp_sync_flags(); return cpu.csr.fcsr & 0x1f;
+        case CSR_FRM: return cpu.csr.fcsr >> 5;
+        case CSR_FCSR: fp_sync_flags(); return cpu.csr.fcsr;
+#endif
+        case CSR_CYCLE ... CSR_CYCLE + NR_COUNTER - 1:
+            return counter(addr - CSR_CYCLE);
+        case CSR_CYCLEH ... CSR_CYCLEH + NR_COUNTER - 1:
+            return counter(addr - CSR_CYCLEH) >> 32;
+        case CSR_MCYCLE ... CSR_MCYCLE + NR_COUNTER - 1:
+            if (addr - CSR_MCYCLE == COUNTER_TIME) break;
+            return counter(addr - CSR_MCYCLE);
+        case CSR_MCYCLEH ... CSR_MCYCLEH + NR_COUNTER - 1:
+            if (addr - CSR_MCYCLEH == COUNTER_TIME) break;
+            return counter(addr - CSR_MCYCLEH) >> 32;
+    }
+    csr_unknown(addr);
+    return 0;
+}
+
+static void csr_write(word_t imm, word_t val) {
+    int addr = imm & 0xfff;
+    if (likely(csr_offset[addr] != 0 && addr != CSR_MHARTID)) {
+        word_t old = CSR_PLAIN(addr);
+        CSR_PLAIN(addr) = val;
+        if (val != old && (addr == CSR_MSTATUS || addr == CSR_MIE || addr == CSR_MIP)) csr_updated();
+        return;
+    }
+    switch (addr) {
+#ifdef CONFIG_RV_FD
+        // the flags raised before are gathered first, since they may be kept
+        case CSR_FFLAGS: fp_sync_flags(); cpu.csr.fcsr = (cpu.csr.fcsr & ~0x1f) | (val & 0x1f); return;
+        case CSR_FRM: fp_sync_flags(); cpu.csr.fcsr = (cpu.csr.fcsr & 0x1f) | ((val & 0x7) << 5); return;
+        case CSR_FCSR: fp_sync_flags(); cpu.csr.fcsr = val & FCSR_MASK; return;
+#endif
+        // mhartid and the user counters are read-only
+        case CSR_MHARTID:
+        case CSR_CYCLE ... CSR_CYCLE + NR_COUNTER - 1:
+        case CSR_CYCLEH ... CSR_CYCLEH + NR_COUNTER - 1:
+            return;
+        case CSR_MCYCLE ... CSR_MCYCLE + NR_COUNTER - 1:
+            if (addr - CSR_MCYCLE == COUNTER_TIME) break;
+            counter_write(addr - CSR_MCYCLE, false, val);
+            return;
+        case CSR_MCYCLEH ... CSR_MCYCLEH + NR_COUNTER - 1:
+            if (addr - CSR_MCYCLEH == COUNTER_TIME) break;
+            counter_write(addr - CSR_MCYCLEH, true, val);
+            return;
+    }
+    csr_unknown(addr);
+}
+
 static void etrace_info(Decode *s) {
 #ifdef CONFIG_ETRACE
     bool success;
@@ -118,21 +231,227 @@ static void etrace_info(Decode *s) {
 #endif
 }
 
+// return from the trap handler, restore MIE from MPIE
+static vaddr_t mret() {
+    if (cpu.csr.mstatus & MSTATUS_MPIE) cpu.csr.mstatus |= MSTATUS_MIE;
+    else cpu.csr.mstatus &= ~MSTATUS_MIE;
+    cpu.csr.mstatus |= MSTATUS_MPIE;
+    csr_updated();
+    return cpu.csr.mepc;
+}
+
+//
+// this part below is for the A extension. The memory is accessed with host
+// atomics, so that the harts on other host threads see the updates at once.
+//
+
+// the reservation set of lr.w
+static HART_LOCAL bool lr_valid = false;
+static HART_LOCAL vaddr_t lr_addr = 0;
+static HART_LOCAL uint32_t lr_val = 0;
+
+// the word is to be written unless it is for lr.w
+static uint32_t *amo_host_addr(vaddr_t addr, bool write) {
+    Assert((addr & 3) == 0 && in_pmem(addr), "invalid address of atomic access " FMT_WORD " at pc = " FMT_WORD,
+           addr, cpu.pc);
+    if (write) pmem_code_check(addr, 4);
+    return (uint32_t *) guest_to_host(addr);
+}
+
+static word_t lr(vaddr_t addr) {
+    lr_addr = addr;
+    lr_val = __atomic_load_n(amo_host_addr(addr, false), __ATOMIC_SEQ_CST);
+    lr_valid = true;
+    return lr_val;
+}
+
+// sc.w succeeds if the memory still holds the value loaded by lr.w
+static word_t sc(vaddr_t addr, word_t val) {
+    uint32_t *p = amo_host_addr(addr, true);
+    bool ok = lr_valid && lr_addr == addr &&
+              __atomic_compare_exchange_n(p, &lr_val, val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    lr_valid = false;
+    return !ok;
+}
+
+enum { AMO_MIN, AMO_MAX, AMO_MINU, AMO_MAXU };
+
+static word_t amo_minmax(vaddr_t addr, word_t val, int op) {
+    uint32_t *p = amo_host_addr(addr, true);
+    uint32_t old = __atomic_load_n(p, __ATOMIC_SEQ_CST), res;
+    do {
+        switch (op) {
+            case AMO_MIN:  res = ((int32_t) old < (int32_t) val ? old : val); break;
+            case AMO_MAX:  res = ((int32_t) old > (int32_t) val ? old : val); break;
+            case AMO_MINU: res = (old < val ? old : val); break;
+            default:       res = (old > val ? old : val); break;
+        }
+    } while (!__atomic_compare_exchange_n(p, &old, res, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    return old;
+}
+
+#define AMO(op, addr, val) __atomic_ ## op(amo_host_addr(addr, true), val, __ATOMIC_SEQ_CST)
+
+//
+// this part below is for the Zba and Zbb extensions, mapped to host builtins.
+//
+
+static inline uint32_t rol(uint32_t x, uint32_t n) { n &= 31; return (x << n) | (x >> ((32 - n) & 31)); }
+static inline uint32_t ror(uint32_t x, uint32_t n) { n &= 31; return (x >> n) | (x << ((32 - n) & 31)); }
+
+// set every non-zero byte to 0xff
+static inline uint32_t orc_b(uint32_t x) {
+    uint32_t t = (((x & 0x7f7f7f7f) + 0x7f7f7f7f) | x) & 0x80808080;
+    return (t >> 7) * 0xff;
+}
+
 #define ECALL(dnpc) {bool success; dnpc = (isa_raise_intr(isa_reg_str2val("a7", &success), s->pc)); assert(success == true);}
-#define CSR(i) *csr_register(i)
+// `t' is the old value of the csr
+#define ZIMM BITS(s->isa.inst.val, 19, 15) // the rs1 field, or the zimm of csrr?i
+#define CSR_RW(val) { word_t t = csr_read(imm); csr_write(imm, val); R(rd) = t; }
+// csrrs and csrrc with x0 (or a zero zimm) only read the csr
+#define CSR_RS(val) { word_t t = csr_read(imm); if (ZIMM != 0) csr_write(imm, val); R(rd) = t; }
+#define BRANCH(cond) { if (cond) { s->dnpc = s->pc + imm; HPM_COUNT(branch); } }
 
+#ifdef CONFIG_RV_FD
+#define F(i) fpr(i)
+#define F32(i) f32(unbox(F(i)))
+#define F64(i) f64(F(i))
+#define FRS1 BITS(s->isa.inst.val, 19, 15)
+#define FRS2 BITS(s->isa.inst.val, 24, 20)
+#define FRS3 BITS(s->isa.inst.val, 31, 27)
+#define SIGN32 0x80000000u
+#define SIGN64 0x8000000000000000ull
 
-static int decode_exec(Decode *s) {
-    int rd = 0;
-    word_t src1 = 0, src2 = 0, imm = 0;
-    s->dnpc = s->snpc;
+// execute with the rounding mode `rm' of the instruction on the host FPU
+#define FP_EXEC(...) do { \
+    int rm = fp_rm(s->isa.inst.val); \
+    if (rm < 0) { INV(s->pc); break; } \
+    if (rm != RM_RNE) fesetround(host_rm[rm]); \
+    __VA_ARGS__; \
+    if (rm != RM_RNE) fesetround(FE_TONEAREST); \
+} while (0)
+#endif
+
+#ifdef CONFIG_INST_FUSION
+//
+// this part below is for instruction fusion. The second instruction of a
+// pair is checked when the first one is decoded, and everything known
+// then, such as the targets relative to the PC, is kept in the entry.
+// A jump to the second instruction just finds its own entry.
+//
+
+enum { FUSE_NONE, FUSE_LI, FUSE_CALL, FUSE_ZEXT, FUSE_SEXT, FUSE_ADDI_BR };
 
-    // Both macros are used by the following macros(INSTPAT) defined in decode.h
-#define INSTPAT_INST(s) ((s)->isa.inst.val)
-#define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
-  decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
-  __VA_ARGS__ ; \
+#define OPCODE(i) BITS(i, 6, 0)
+#define FUNCT3(i) BITS(i, 14, 12)
+#define RD(i)     BITS(i, 11, 7)
+#define RS1(i)    BITS(i, 19, 15)
+#define RS2(i)    BITS(i, 24, 20)
+#define IMM_I(i)  SEXT(BITS(i, 31, 20), 12)
+#define IMM_U(i)  (BITS(i, 31, 12) << 12)
+#define IMM_B(i)  ((SEXT(BITS(i, 31, 31), 1) << 12) | BITS(i, 7, 7) << 11 | BITS(i, 30, 25) << 5 | BITS(i, 11, 8) << 1)
+#define IS_ADDI(i) (OPCODE(i) == 0x13 && FUNCT3(i) == 0)
+
+static void fuse_check(Decode *s, DecodeEntry *e) {
+    uint32_t i1 = e->inst, i2;
+    int rd = RD(i1);
+    e->fuse = FUSE_NONE;
+    if (rd == 0 || !in_pmem(s->snpc) || !in_pmem(s->snpc + 3)) return;
+    uint32_t raw2 = vaddr_ifetch(s->snpc, 4);
+    int len2 = 4;
+#ifdef CONFIG_RVC
+    if ((raw2 & 0x3) != 0x3) {
+        raw2 &= 0xffff;
+        len2 = 2;
+        i2 = rvc_table[raw2];
+    } else
+#endif
+    i2 = raw2;
+    word_t next = s->snpc + len2;
+
+    if ((OPCODE(i1) == 0x37 || OPCODE(i1) == 0x17) && IS_ADDI(i2) && RD(i2) == rd && RS1(i2) == rd) {
+        // lui/auipc + addi
+        e->fuse = FUSE_LI;
+        e->fimm = (OPCODE(i1) == 0x17 ? s->pc : 0) + IMM_U(i1) + IMM_I(i2);
+    } else if (OPCODE(i1) == 0x17 && OPCODE(i2) == 0x67 && FUNCT3(i2) == 0 && RS1(i2) == rd) {
+        // auipc + jalr
+        e->fuse = FUSE_CALL;
+        e->fimm = s->pc + IMM_U(i1);
+        e->ftarget = (e->fimm + IMM_I(i2)) & ~1;
+        e->frd = RD(i2);
+    } else if (OPCODE(i1) == 0x13 && BITS(i1, 31, 25) == 0 && FUNCT3(i1) == 1 &&
+               OPCODE(i2) == 0x13 && FUNCT3(i2) == 5 && (BITS(i2, 31, 25) & ~0x20) == 0 &&
+               RD(i2) == rd && RS1(i2) == rd && RS2(i2) == RS2(i1)) {
+        // slli + srli/srai
+        e->fuse = (BITS(i2, 30, 30) ? FUSE_SEXT : FUSE_ZEXT);
+        e->frs = RS1(i1);
+        e->fimm = RS2(i1);
+    } else if (IS_ADDI(i1) && OPCODE(i2) == 0x63 && FUNCT3(i2) != 2 && FUNCT3(i2) != 3 &&
+               (RS1(i2) == rd || RS2(i2) == rd)) {
+        // addi + branch
+        e->fuse = FUSE_ADDI_BR;
+        e->frs = RS1(i1);
+        e->fimm = IMM_I(i1);
+        e->brs1 = RS1(i2);
+        e->brs2 = RS2(i2);
+        e->bop = FUNCT3(i2);
+        e->ftarget = s->snpc + IMM_B(i2);
+    } else {
+        return;
+    }
+    e->raw2 = raw2;
+    e->len2 = len2;
+    e->fnext = next;
+}
+
+static inline bool branch_taken(int op, word_t a, word_t b) {
+    switch (op) {
+        case 0: return a == b;
+        case 1: return a != b;
+        case 4: return (sword_t) a < (sword_t) b;
+        case 5: return (sword_t) a >= (sword_t) b;
+        case 6: return a < b;
+        default: return a >= b;
+    }
+}
+
+// execute the pair if the second instruction is still the same
+static bool fuse_exec(Decode *s, DecodeEntry *e) {
+    uint32_t raw2 = vaddr_ifetch(s->snpc, e->len2);
+    if (raw2 != e->raw2) return false;
+    s->snpc = e->fnext;
+    s->dnpc = e->fnext;
+    switch (e->fuse) {
+        case FUSE_LI:
+            R(e->rd) = e->fimm;
+            break;
+        case FUSE_CALL:
+            R(e->rd) = e->fimm;
+            R(e->frd) = e->fnext;
+            s->dnpc = e->ftarget;
+            break;
+        case FUSE_ZEXT:
+            R(e->rd) = (R(e->frs) << e->fimm) >> e->fimm;
+            break;
+        case FUSE_SEXT:
+            R(e->rd) = (sword_t) (R(e->frs) << e->fimm) >> e->fimm;
+            break;
+        case FUSE_ADDI_BR:
+            R(e->rd) = R(e->frs) + e->fimm;
+            if (branch_taken(e->bop, R(e->brs1), R(e->brs2))) {
+                s->dnpc = e->ftarget;
+                HPM_COUNT(branch);
+            }
+            break;
+    }
+    s->ninst = 2;
+    return true;
 }
+#endif
+
+static int decode_exec(Decode *s) {
+    DECODE_EXEC_BEGIN(s);
 
     INSTPAT_START();
         // pattern | key | mask | shift
@@ -158,17 +477,29 @@ static int decode_exec(Decode *s) {
         INSTPAT("0000000 ????? ????? 100 ????? 01100 11", xor, R, R(rd) = src1 ^ src2);
         INSTPAT("0000000 ????? ????? 110 ????? 01100 11", or, R, R(rd) = src1 | src2);
 
+        /* A */
+        INSTPAT("00010?? 00000 ????? 010 ????? 01011 11", lr_w, R, R(rd) = lr(src1));
+        INSTPAT("00011?? ????? ????? 010 ????? 01011 11", sc_w, R, R(rd) = sc(src1, src2));
+        INSTPAT("00001?? ????? ????? 010 ????? 01011 11", amoswap_w, R, R(rd) = AMO(exchange_n, src1, src2));
+        INSTPAT("00000?? ????? ????? 010 ????? 01011 11", amoadd_w, R, R(rd) = AMO(fetch_add, src1, src2));
+        INSTPAT("00100?? ????? ????? 010 ????? 01011 11", amoxor_w, R, R(rd) = AMO(fetch_xor, src1, src2));
+        INSTPAT("01100?? ????? ????? 010 ????? 01011 11", amoand_w, R, R(rd) = AMO(fetch_and, src1, src2));
+        INSTPAT("01000?? ????? ????? 010 ????? 01011 11", amoor_w, R, R(rd) = AMO(fetch_or, src1, src2));
+        INSTPAT("10000?? ????? ????? 010 ????? 01011 11", amomin_w, R, R(rd) = amo_minmax(src1, src2, AMO_MIN));
+        INSTPAT("10100?? ????? ????? 010 ????? 01011 11", amomax_w, R, R(rd) = amo_minmax(src1, src2, AMO_MAX));
+        INSTPAT("11000?? ????? ????? 010 ????? 01011 11", amominu_w, R, R(rd) = amo_minmax(src1, src2, AMO_MINU));
+        INSTPAT("11100?? ????? ????? 010 ????? 01011 11", amomaxu_w, R, R(rd) = amo_minmax(src1, src2, AMO_MAXU));
+
         /* I */
-        INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu, I, R(rd) = Mr(src1 + imm, 1));
-        INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb, I, R(rd) = SEXT(Mr(src1 + imm, 1), 16));
-        INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh, I, R(rd) = SEXT(Mr(src1 + imm, 2), 16));
-        INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu, I, R(rd) = Mr(src1 + imm, 2));
-        INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw, I, R(rd) = Mr(src1 + imm, 4));
+        INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu, I, R(rd) = Mr(src1 + imm, 8));
+        INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb, I, R(rd) = SEXT(Mr(src1 + imm, 8), 8));
+        INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh, I, R(rd) = SEXT(Mr(src1 + imm, 16), 16));
+        INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu, I, R(rd) = Mr(src1 + imm, 16));
+        INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw, I, R(rd) = Mr(src1 + imm, 32));
         INSTPAT("??????? ????? ????? 111 ????? 00100 11", andi, I, R(rd) = imm & src1);
         INSTPAT("??????? ????? ????? 100 ????? 00100 11", xori, I, R(rd) = src1 ^ imm);
         INSTPAT("??????? ????? ????? 110 ????? 00100 11", ori, I, R(rd) = src1 | imm);
         INSTPAT("??????? ????? ????? 000 ????? 00100 11", addi, I, R(rd) = src1 + imm);
-        INSTPAT("??????? ????? ????? 000 ????? 00100 11", li, I, R(rd) = src1 + imm);
         INSTPAT("0000000 ????? ????? 001 ????? 00100 11", elli, I, R(rd) = src1 << imm);
         INSTPAT("??????? ????? ????? 011 ????? 00100 11", sltiu, I, R(rd) = (uint32_t) src1 < (uint32_t) imm ? 1 : 0);
         INSTPAT("??????? ????? ????? 010 ????? 00100 11", slti, I, R(rd) = (int32_t) src1 < (int32_t) imm ? 1 : 0);
@@ -176,7 +507,7 @@ static int decode_exec(Decode *s) {
         INSTPAT("0100000 ????? ????? 101 ????? 00100 11", srai, I,
                 imm = BITS(imm, 4, 0); R(rd) = (SEXT(BITS(src1, 31, 31), 1) << (32 - imm)) | (src1 >> imm));
         INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr, I,
-                R(rd) = s->pc + 4; s->dnpc = (src1 + imm) & ~1;
+                R(rd) = s->snpc; s->dnpc = (src1 + imm) & ~1;
                         IFDEF(CONFIG_FTRACE,
                               if(rd == 1){
                                   display_call_func(s->pc, s->dnpc);
@@ -184,65 +515,170 @@ static int decode_exec(Decode *s) {
                                   display_ret_func(s->pc);
                               });
                         );
-        INSTPAT("??????? ????? ????? 000 ????? 11001 11", ret, I,
-                R(rd) = s->pc + 4; s->dnpc = (src1 + imm) & ~1;
-                        IFDEF(CONFIG_FTRACE,
-                              if(rd == 1){
-                                  display_call_func(s->pc, s->dnpc);
-                              } else if (rd == 0 && src1 == R(1)) {
-                                  display_ret_func(s->pc);
-                              });
-                        ); // jalr(ret)
 
         /* S */
-        INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb, S, Mw(src1 + imm, 1, src2));
-        INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh, S, Mw(src1 + imm, 2, src2));
-        INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw, S, Mw(src1 + imm, 4, src2));
-        INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, R(rd) = CSR(imm); CSR(imm) = src1);
-        INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, R(rd) = CSR(imm); CSR(imm) |= src1);
+        INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb, S, Mw(src1 + imm, 8, src2));
+        INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh, S, Mw(src1 + imm, 16, src2));
+        INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw, S, Mw(src1 + imm, 32, src2));
+        INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, CSR_RW(src1));
+        INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, CSR_RS(t | src1));
+        INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, CSR_RS(t & ~src1));
+        INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi , I, CSR_RW(ZIMM));
+        INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi , I, CSR_RS(t | ZIMM));
+        INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci , I, CSR_RS(t & ~ZIMM));
 
 
         /* B */
-        INSTPAT("??????? ????? ????? 100 ????? 11000 11", blt, B,
-                s->dnpc += (int) src1 < (int) src2 ? imm - 4 : 0);
-        INSTPAT("??????? ????? ????? 110 ????? 11000 11", bltu, B,
-                s->dnpc += (uint32_t) src1 < (uint32_t) src2 ? imm - 4 : 0);
-        INSTPAT("??????? ????? ????? 101 ????? 11000 11", bge, B,
-                s->dnpc += (int) src1 >= (int) src2 ? imm - 4 : 0);
-        INSTPAT("??????? ????? ????? 111 ????? 11000 11", bgeu, B,
-                s->dnpc += src1 >= src2 ? imm - 4 : 0;);
-        INSTPAT("??????? ????? ????? 000 ????? 11000 11", beq, B,
-                s->dnpc += src1 == src2 ? imm - 4 : 0;);
-        INSTPAT("??????? ????? ????? 001 ????? 11000 11", bne, B,
-                s->dnpc += src1 != src2 ? imm - 4 : 0;);
+        INSTPAT("??????? ????? ????? 100 ????? 11000 11", blt, B, BRANCH((sword_t) src1 < (sword_t) src2));
+        INSTPAT("??????? ????? ????? 110 ????? 11000 11", bltu, B, BRANCH(src1 < src2));
+        INSTPAT("??????? ????? ????? 101 ????? 11000 11", bge, B, BRANCH((sword_t) src1 >= (sword_t) src2));
+        INSTPAT("??????? ????? ????? 111 ????? 11000 11", bgeu, B, BRANCH(src1 >= src2));
+        INSTPAT("??????? ????? ????? 000 ????? 11000 11", beq, B, BRANCH(src1 == src2));
+        INSTPAT("??????? ????? ????? 001 ????? 11000 11", bne, B, BRANCH(src1 != src2));
 
         /* U */
         INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc, U, R(rd) = s->pc + imm);
         INSTPAT("??????? ????? ????? ??? ????? 01101 11", lui, U, R(rd) = imm);
 
         /* J */
-        // JAL stores the address of the instruction following the jump (pc+4) into register rd.
-        INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal, J, R(rd) = s->pc + 4; s->dnpc += imm - 4;
+        // JAL stores the address of the instruction following the jump (snpc) into register rd.
+        INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal, J, R(rd) = s->snpc; s->dnpc = s->pc + imm;
                 IFDEF(CONFIG_FTRACE, if (rd == 1) {
                     display_call_func(s->pc, s->dnpc);
                 });
         );
 
+#ifdef CONFIG_RV_ZB
+        // after the base instructions, which are more frequent
+        /* Zba */
+        INSTPAT("0010000 ????? ????? 010 ????? 01100 11", sh1add, R, R(rd) = (src1 << 1) + src2);
+        INSTPAT("0010000 ????? ????? 100 ????? 01100 11", sh2add, R, R(rd) = (src1 << 2) + src2);
+        INSTPAT("0010000 ????? ????? 110 ????? 01100 11", sh3add, R, R(rd) = (src1 << 3) + src2);
+
+        /* Zbb */
+        INSTPAT("0100000 ????? ????? 111 ????? 01100 11", andn, R, R(rd) = src1 & ~src2);
+        INSTPAT("0100000 ????? ????? 110 ????? 01100 11", orn, R, R(rd) = src1 | ~src2);
+        INSTPAT("0100000 ????? ????? 100 ????? 01100 11", xnor, R, R(rd) = ~(src1 ^ src2));
+        INSTPAT("0000101 ????? ????? 110 ????? 01100 11", max, R, R(rd) = ((int32_t) src1 > (int32_t) src2 ? src1 : src2));
+        INSTPAT("0000101 ????? ????? 111 ????? 01100 11", maxu, R, R(rd) = (src1 > src2 ? src1 : src2));
+        INSTPAT("0000101 ????? ????? 100 ????? 01100 11", min, R, R(rd) = ((int32_t) src1 < (int32_t) src2 ? src1 : src2));
+        INSTPAT("0000101 ????? ????? 101 ????? 01100 11", minu, R, R(rd) = (src1 < src2 ? src1 : src2));
+        INSTPAT("0110000 ????? ????? 001 ????? 01100 11", rol, R, R(rd) = rol(src1, src2));
+        INSTPAT("0110000 ????? ????? 101 ????? 01100 11", ror, R, R(rd) = ror(src1, src2));
+        INSTPAT("0000100 00000 ????? 100 ????? 01100 11", zext_h, R, R(rd) = (uint16_t) src1);
+        INSTPAT("0110000 00000 ????? 001 ????? 00100 11", clz, I, R(rd) = (src1 == 0 ? 32 : __builtin_clz(src1)));
+        INSTPAT("0110000 00001 ????? 001 ????? 00100 11", ctz, I, R(rd) = (src1 == 0 ? 32 : __builtin_ctz(src1)));
+        INSTPAT("0110000 00010 ????? 001 ????? 00100 11", cpop, I, R(rd) = __builtin_popcount(src1));
+        INSTPAT("0110000 00100 ????? 001 ????? 00100 11", sext_b, I, R(rd) = (int8_t) src1);
+        INSTPAT("0110000 00101 ????? 001 ????? 00100 11", sext_h, I, R(rd) = (int16_t) src1);
+        INSTPAT("0110000 ????? ????? 101 ????? 00100 11", rori, I, R(rd) = ror(src1, imm));
+        INSTPAT("0010100 00111 ????? 101 ????? 00100 11", orc_b, I, R(rd) = orc_b(src1));
+        INSTPAT("0110100 11000 ????? 101 ????? 00100 11", rev8, I, R(rd) = __builtin_bswap32(src1));
+#endif
+
+#ifdef CONFIG_RV_FD
+        /* F */
+        INSTPAT("??????? ????? ????? 010 ????? 00001 11", flw, I, F(rd) = box(Mr(src1 + imm, 32)));
+        INSTPAT("??????? ????? ????? 010 ????? 01001 11", fsw, S, Mw(src1 + imm, 32, (uint32_t) F(FRS2)));
+        INSTPAT("0000000 ????? ????? ??? ????? 10100 11", fadd_s, N, FP_EXEC(F(rd) = box_f32(F32(FRS1) + F32(FRS2))));
+        INSTPAT("0000100 ????? ????? ??? ????? 10100 11", fsub_s, N, FP_EXEC(F(rd) = box_f32(F32(FRS1) - F32(FRS2))));
+        INSTPAT("0001000 ????? ????? ??? ????? 10100 11", fmul_s, N, FP_EXEC(F(rd) = box_f32(F32(FRS1) * F32(FRS2))));
+        INSTPAT("0001100 ????? ????? ??? ????? 10100 11", fdiv_s, N, FP_EXEC(F(rd) = box_f32(F32(FRS1) / F32(FRS2))));
+        INSTPAT("0101100 00000 ????? ??? ????? 10100 11", fsqrt_s, N, FP_EXEC(F(rd) = box_f32(sqrtf(F32(FRS1)))));
+        INSTPAT("?????00 ????? ????? ??? ????? 10000 11", fmadd_s, N,
+                FP_EXEC(F(rd) = box_f32(fmaf(F32(FRS1), F32(FRS2), F32(FRS3)))));
+        INSTPAT("?????00 ????? ????? ??? ????? 10001 11", fmsub_s, N,
+                FP_EXEC(F(rd) = box_f32(fmaf(F32(FRS1), F32(FRS2), -F32(FRS3)))));
+        INSTPAT("?????00 ????? ????? ??? ????? 10010 11", fnmsub_s, N,
+                FP_EXEC(F(rd) = box_f32(fmaf(-F32(FRS1), F32(FRS2), F32(FRS3)))));
+        INSTPAT("?????00 ????? ????? ??? ????? 10011 11", fnmadd_s, N,
+                FP_EXEC(F(rd) = box_f32(fmaf(-F32(FRS1), F32(FRS2), -F32(FRS3)))));
+        INSTPAT("0010000 ????? ????? 000 ????? 10100 11", fsgnj_s, N,
+                F(rd) = box((unbox(F(FRS1)) & ~SIGN32) | (unbox(F(FRS2)) & SIGN32)));
+        INSTPAT("0010000 ????? ????? 001 ????? 10100 11", fsgnjn_s, N,
+                F(rd) = box((unbox(F(FRS1)) & ~SIGN32) | (~unbox(F(FRS2)) & SIGN32)));
+        INSTPAT("0010000 ????? ????? 010 ????? 10100 11", fsgnjx_s, N,
+                F(rd) = box(unbox(F(FRS1)) ^ (unbox(F(FRS2)) & SIGN32)));
+        INSTPAT("0010100 ????? ????? 000 ????? 10100 11", fmin_s, N, F(rd) = box(f32_minmax(unbox(F(FRS1)), unbox(F(FRS2)), false)));
+        INSTPAT("0010100 ????? ????? 001 ????? 10100 11", fmax_s, N, F(rd) = box(f32_minmax(unbox(F(FRS1)), unbox(F(FRS2)), true)));
+        INSTPAT("1010000 ????? ????? 010 ????? 10100 11", feq_s, N, R(rd) = f32_eq(unbox(F(FRS1)), unbox(F(FRS2))));
+        INSTPAT("1010000 ????? ????? 001 ????? 10100 11", flt_s, N, R(rd) = f32_lt(unbox(F(FRS1)), unbox(F(FRS2))));
+        INSTPAT("1010000 ????? ????? 000 ????? 10100 11", fle_s, N, R(rd) = f32_le(unbox(F(FRS1)), unbox(F(FRS2))));
+        INSTPAT("1110000 00000 ????? 001 ????? 10100 11", fclass_s, N, R(rd) = f32_class(unbox(F(FRS1))));
+        INSTPAT("1100000 00000 ????? ??? ????? 10100 11", fcvt_w_s, N, FP_EXEC(R(rd) = fp_to_i32(F32(FRS1), rm)));
+        INSTPAT("1100000 00001 ????? ??? ????? 10100 11", fcvt_wu_s, N, FP_EXEC(R(rd) = fp_to_u32(F32(FRS1), rm)));
+        INSTPAT("1101000 00000 ????? ??? ????? 10100 11", fcvt_s_w, R, FP_EXEC(F(rd) = box_f32((int32_t) src1)));
+        INSTPAT("1101000 00001 ????? ??? ????? 10100 11", fcvt_s_wu, R, FP_EXEC(F(rd) = box_f32(src1)));
+        INSTPAT("1110000 00000 ????? 000 ????? 10100 11", fmv_x_w, N, R(rd) = (uint32_t) F(FRS1));
+        INSTPAT("1111000 00000 ????? 000 ????? 10100 11", fmv_w_x, R, F(rd) = box(src1));
+
+        /* D */
+        INSTPAT("??????? ????? ????? 011 ????? 00001 11", fld, I,
+                F(rd) = Mr(src1 + imm, 32) | ((uint64_t) vaddr_read32(src1 + imm + 4) << 32));
+        INSTPAT("??????? ????? ????? 011 ????? 01001 11", fsd, S,
+                Mw(src1 + imm, 32, (uint32_t) F(FRS2)); vaddr_write32(src1 + imm + 4, F(FRS2) >> 32));
+        INSTPAT("0000001 ????? ????? ??? ????? 10100 11", fadd_d, N, FP_EXEC(F(rd) = res_f64(F64(FRS1) + F64(FRS2))));
+        INSTPAT("0000101 ????? ????? ??? ????? 10100 11", fsub_d, N, FP_EXEC(F(rd) = res_f64(F64(FRS1) - F64(FRS2))));
+        INSTPAT("0001001 ????? ????? ??? ????? 10100 11", fmul_d, N, FP_EXEC(F(rd) = res_f64(F64(FRS1) * F64(FRS2))));
+        INSTPAT("0001101 ????? ????? ??? ????? 10100 11", fdiv_d, N, FP_EXEC(F(rd) = res_f64(F64(FRS1) / F64(FRS2))));
+        INSTPAT("0101101 00000 ????? ??? ????? 10100 11", fsqrt_d, N, FP_EXEC(F(rd) = res_f64(sqrt(F64(FRS1)))));
+        INSTPAT("?????01 ????? ????? ??? ????? 10000 11", fmadd_d, N,
+                FP_EXEC(F(rd) = res_f64(fma(F64(FRS1), F64(FRS2), F64(FRS3)))));
+        INSTPAT("?????01 ????? ????? ??? ????? 10001 11", fmsub_d, N,
+                FP_EXEC(F(rd) = res_f64(fma(F64(FRS1), F64(FRS2), -F64(FRS3)))));
+        INSTPAT("?????01 ????? ????? ??? ????? 10010 11", fnmsub_d, N,
+                FP_EXEC(F(rd) = res_f64(fma(-F64(FRS1), F64(FRS2), F64(FRS3)))));
+        INSTPAT("?????01 ????? ????? ??? ????? 10011 11", fnmadd_d, N,
+                FP_EXEC(F(rd) = res_f64(fma(-F64(FRS1), F64(FRS2), -F64(FRS3)))));
+        INSTPAT("0010001 ????? ????? 000 ????? 10100 11", fsgnj_d, N, F(rd) = (F(FRS1) & ~SIGN64) | (F(FRS2) & SIGN64));
+        INSTPAT("0010001 ????? ????? 001 ????? 10100 11", fsgnjn_d, N, F(rd) = (F(FRS1) & ~SIGN64) | (~F(FRS2) & SIGN64));
+        INSTPAT("0010001 ????? ????? 010 ????? 10100 11", fsgnjx_d, N, F(rd) = F(FRS1) ^ (F(FRS2) & SIGN64));
+        INSTPAT("0010101 ????? ????? 000 ????? 10100 11", fmin_d, N, F(rd) = f64_minmax(F(FRS1), F(FRS2), false));
+        INSTPAT("0010101 ????? ????? 001 ????? 10100 11", fmax_d, N, F(rd) = f64_minmax(F(FRS1), F(FRS2), true));
+        INSTPAT("1010001 ????? ????? 010 ????? 10100 11", feq_d, N, R(rd) = f64_eq(F(FRS1), F(FRS2)));
+        INSTPAT("1010001 ????? ????? 001 ????? 10100 11", flt_d, N, R(rd) = f64_lt(F(FRS1), F(FRS2)));
+        INSTPAT("1010001 ????? ????? 000 ????? 10100 11", fle_d, N, R(rd) = f64_le(F(FRS1), F(FRS2)));
+        INSTPAT("1110001 00000 ????? 001 ????? 10100 11", fclass_d, N, R(rd) = f64_class(F(FRS1)));
+        INSTPAT("0100000 00001 ????? ??? ????? 10100 11", fcvt_s_d, N, FP_EXEC(F(rd) = box_f32(F64(FRS1))));
+        INSTPAT("0100001 00000 ????? ??? ????? 10100 11", fcvt_d_s, N, FP_EXEC(F(rd) = res_f64(F32(FRS1))));
+        INSTPAT("1100001 00000 ????? ??? ????? 10100 11", fcvt_w_d, N, FP_EXEC(R(rd) = fp_to_i32(F64(FRS1), rm)));
+        INSTPAT("1100001 00001 ????? ??? ????? 10100 11", fcvt_wu_d, N, FP_EXEC(R(rd) = fp_to_u32(F64(FRS1), rm)));
+        INSTPAT("1101001 00000 ????? ??? ????? 10100 11", fcvt_d_w, R, FP_EXEC(F(rd) = res_f64((int32_t) src1)));
+        INSTPAT("1101001 00001 ????? ??? ????? 10100 11", fcvt_d_wu, R, FP_EXEC(F(rd) = res_f64(src1)));
+#endif
+
         /* N */
         INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak, N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
         INSTPAT("0000000 00000 00000 000 00000 11100 11", ecall, N, etrace_info(s); ECALL(s->dnpc));
-        INSTPAT("0011000 00010 00000 000 00000 11100 11", met, N, s->dnpc = cpu.csr.mepc);
+        INSTPAT("0011000 00010 00000 000 00000 11100 11", met, N, s->dnpc = mret());
+        INSTPAT("0001000 00101 00000 000 00000 11100 11", wfi, N, IFDEF(CONFIG_DEVICE, device_idle()));
+        INSTPAT("??????? ????? ????? 000 ????? 00011 11", fence, N, IFDEF(CONFIG_MULTI_HART, __atomic_thread_fence(__ATOMIC_SEQ_CST)));
+        INSTPAT("??????? ????? ????? 001 ????? 00011 11", fence_i, N);
         INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv, N, INV(s->pc));
 
 
     INSTPAT_END();
 
-    R(0) = 0; // reset $zero to 0
-
-    return 0;
+    DECODE_EXEC_END(s);
 }
 
 int isa_exec_once(Decode *s) {
+#ifdef CONFIG_RVC
+    uint32_t inst = inst_fetch(&s->snpc, 2);
+    if ((inst & 0x3) != 0x3) {
+        s->isa.inst.val = rvc_table[inst];
+        int ret = decode_exec(s);
+        s->isa.inst.val = inst; // trace the compressed instruction
+        return ret;
+    }
+    s->isa.inst.val = inst | (inst_fetch(&s->snpc, 2) << 16);
+#else
     s->isa.inst.val = inst_fetch(&s->snpc, 4);
+#endif
     return decode_exec(s);
 }
+
+#ifdef CONFIG_RV_FD
+void isa_fp_save() { fp_sync_flags(); }
+void isa_fp_restore() { feclearexcept(FE_ALL_EXCEPT); }
+#endif
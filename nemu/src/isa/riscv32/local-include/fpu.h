@@ -0,0 +1,161 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __RISCV_FPU_H__
+#define __RISCV_FPU_H__
+
+#include <isa.h>
+#include <fenv.h>
+#include <math.h>
+
+/* The F and D extensions are executed on the host FPU. A single is kept
+ * NaN-boxed in the 64-bit register. The exception flags are left in the
+ * host FPU, and only gathered into fcsr when fflags or fcsr is accessed,
+ * or before the host runs its own code by isa_fp_save().
+ */
+
+#define fpr(idx) (cpu.fpr[idx])
+
+// bits in fflags
+#define FFLAGS_NX 0x01
+#define FFLAGS_UF 0x02
+#define FFLAGS_OF 0x04
+#define FFLAGS_DZ 0x08
+#define FFLAGS_NV 0x10
+
+#define FCSR_MASK 0xff
+
+enum { RM_RNE, RM_RTZ, RM_RDN, RM_RUP, RM_RMM, RM_DYN = 7 };
+
+#define F32_DEFAULT_NAN 0x7fc00000u
+#define F64_DEFAULT_NAN 0x7ff8000000000000ull
+
+static inline float f32(uint32_t v) { float f; memcpy(&f, &v, 4); return f; }
+static inline double f64(uint64_t v) { double d; memcpy(&d, &v, 8); return d; }
+static inline uint32_t f32_bits(float f) { uint32_t v; memcpy(&v, &f, 4); return v; }
+static inline uint64_t f64_bits(double d) { uint64_t v; memcpy(&v, &d, 8); return v; }
+
+// a single without a valid NaN-boxing is read as the canonical NaN
+static inline uint32_t unbox(uint64_t v) {
+  return (v >> 32) == 0xffffffffu ? (uint32_t)v : F32_DEFAULT_NAN;
+}
+static inline uint64_t box(uint32_t v) { return 0xffffffff00000000ull | v; }
+
+// an arithmetic result which is a NaN is the canonical NaN
+static inline uint64_t box_f32(float f) { return box(isnan(f) ? F32_DEFAULT_NAN : f32_bits(f)); }
+static inline uint64_t res_f64(double d) { return isnan(d) ? F64_DEFAULT_NAN : f64_bits(d); }
+
+static inline bool f32_is_snan(uint32_t v) {
+  return (v & 0x7fc00000u) == 0x7f800000u && (v & 0x3fffffu);
+}
+static inline bool f64_is_snan(uint64_t v) {
+  return (v & 0x7ff8000000000000ull) == 0x7ff0000000000000ull && (v & 0x7ffffffffffffull);
+}
+
+static inline void fp_raise(int flags) { cpu.csr.fcsr |= flags; }
+
+// move the flags raised by the host FPU into fcsr
+static inline void fp_sync_flags() {
+  int e = fetestexcept(FE_ALL_EXCEPT);
+  if (e == 0) return;
+  fp_raise((e & FE_INEXACT   ? FFLAGS_NX : 0) | (e & FE_UNDERFLOW ? FFLAGS_UF : 0) |
+           (e & FE_OVERFLOW  ? FFLAGS_OF : 0) | (e & FE_DIVBYZERO ? FFLAGS_DZ : 0) |
+           (e & FE_INVALID   ? FFLAGS_NV : 0));
+  feclearexcept(FE_ALL_EXCEPT);
+}
+
+// RMM has no host counterpart, and rounds as RNE except in conversions to integers
+static const int host_rm[] = {
+  [RM_RNE] = FE_TONEAREST, [RM_RTZ] = FE_TOWARDZERO, [RM_RDN] = FE_DOWNWARD,
+  [RM_RUP] = FE_UPWARD, [RM_RMM] = FE_TONEAREST,
+};
+
+// the rounding mode of the instruction, -1 if it is reserved
+static inline int fp_rm(uint32_t inst) {
+  int rm = BITS(inst, 14, 12);
+  if (rm == RM_DYN) rm = cpu.csr.fcsr >> 5;
+  return rm <= RM_RMM ? rm : -1;
+}
+
+// round to an integer with `rm'
+static inline double fp_round(double x, int rm) {
+  switch (rm) {
+    case RM_RTZ: return trunc(x);
+    case RM_RDN: return floor(x);
+    case RM_RUP: return ceil(x);
+    case RM_RMM: return round(x);
+    default: return nearbyint(x);
+  }
+}
+
+// fcvt.w.* and fcvt.wu.*, which saturate and raise only NV when out of range
+static inline word_t fp_to_i32(double x, int rm) {
+  if (isnan(x)) { fp_raise(FFLAGS_NV); return INT32_MAX; }
+  double r = fp_round(x, rm);
+  if (r < INT32_MIN) { fp_raise(FFLAGS_NV); return INT32_MIN; }
+  if (r > INT32_MAX) { fp_raise(FFLAGS_NV); return INT32_MAX; }
+  if (r != x) fp_raise(FFLAGS_NX);
+  return (int32_t)r;
+}
+
+static inline word_t fp_to_u32(double x, int rm) {
+  if (isnan(x)) { fp_raise(FFLAGS_NV); return UINT32_MAX; }
+  double r = fp_round(x, rm);
+  if (r < 0) { fp_raise(FFLAGS_NV); return 0; }
+  if (r > UINT32_MAX) { fp_raise(FFLAGS_NV); return UINT32_MAX; }
+  if (r != x) fp_raise(FFLAGS_NX);
+  return (uint32_t)r;
+}
+
+/* The operations below are the same for both formats except the width,
+ * and are defined for both of them by the macro.
+ */
+#define FP_DEF(T, UT, W, SIGN, EXP) \
+  /* a NaN operand gives the other one, and -0.0 is less than +0.0 */ \
+  static inline UT f##W##_minmax(UT a, UT b, bool is_max) { \
+    if (f##W##_is_snan(a) || f##W##_is_snan(b)) fp_raise(FFLAGS_NV); \
+    T fa = f##W(a), fb = f##W(b); \
+    if (isnan(fa)) return isnan(fb) ? F##W##_DEFAULT_NAN : b; \
+    if (isnan(fb)) return a; \
+    if (fa == fb) return is_max ? (a & b) : (a | b); \
+    return ((fa < fb) != is_max) ? a : b; \
+  } \
+  /* feq is quiet, while flt and fle are signaling */ \
+  static inline word_t f##W##_eq(UT a, UT b) { \
+    if (f##W##_is_snan(a) || f##W##_is_snan(b)) fp_raise(FFLAGS_NV); \
+    return f##W(a) == f##W(b); \
+  } \
+  static inline word_t f##W##_lt(UT a, UT b) { \
+    if (isnan(f##W(a)) || isnan(f##W(b))) { fp_raise(FFLAGS_NV); return 0; } \
+    return f##W(a) < f##W(b); \
+  } \
+  static inline word_t f##W##_le(UT a, UT b) { \
+    if (isnan(f##W(a)) || isnan(f##W(b))) { fp_raise(FFLAGS_NV); return 0; } \
+    return f##W(a) <= f##W(b); \
+  } \
+  /* by the bits, since the host may raise NV for a signaling NaN */ \
+  static inline word_t f##W##_class(UT a) { \
+    bool neg = (a & SIGN) != 0; \
+    UT exp = a & EXP, frac = a & ~(SIGN | EXP); \
+    if (exp == EXP) return frac == 0 ? (neg ? 1 << 0 : 1 << 7) : (f##W##_is_snan(a) ? 1 << 8 : 1 << 9); \
+    if (exp != 0) return neg ? 1 << 1 : 1 << 6; \
+    if (frac != 0) return neg ? 1 << 2 : 1 << 5; \
+    return neg ? 1 << 3 : 1 << 4; \
+  }
+
+FP_DEF(float, uint32_t, 32, 0x80000000u, 0x7f800000u)
+FP_DEF(double, uint64_t, 64, 0x8000000000000000ull, 0x7ff0000000000000ull)
+
+#endif
@@ -25,6 +25,31 @@ static inline int check_reg_idx(int idx) {
 
 #define gpr(idx) (cpu.gpr[check_reg_idx(idx)])
 
+// the addresses of CSRs
+enum {
+  CSR_FFLAGS = 0x001, CSR_FRM = 0x002, CSR_FCSR = 0x003,
+  CSR_MSTATUS = 0x300, CSR_MIE = 0x304, CSR_MTVEC = 0x305,
+  CSR_MEPC = 0x341, CSR_MCAUSE = 0x342, CSR_MIP = 0x344,
+  CSR_MCYCLE = 0xb00, CSR_MCYCLEH = 0xb80,
+  CSR_CYCLE = 0xc00, CSR_CYCLEH = 0xc80,
+  CSR_MHARTID = 0xf14,
+};
+
+// counter 1 is time, and counters 3 to 31 are the hpmcounters
+#define NR_COUNTER 32
+#define COUNTER_TIME 1
+
+// bits in mstatus
+#define MSTATUS_MIE  (1u << 3)
+#define MSTATUS_MPIE (1u << 7)
+
+// bits in mie and mip
+#define MIP_MSIP (1u << 3)
+#define MIP_MTIP (1u << 7)
+#define MIP_MEIP (1u << 11)
+
+#define IRQ(n) (((word_t)1 << (sizeof(word_t) * 8 - 1)) | (n))
+
 static inline const char* reg_name(int idx) {
   extern const char* regs[];
   return regs[check_reg_idx(idx)];
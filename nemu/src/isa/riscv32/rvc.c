@@ -0,0 +1,153 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+
+/* Every 16-bit instruction of the C extension is expanded to the 32-bit
+ * instruction it stands for, so decode_exec() only handles the base
+ * encodings. The expansions of all 65536 halfwords are computed once into
+ * a table. An illegal or reserved encoding expands to 0, which is illegal.
+ */
+
+enum {
+  OP_LOAD = 0x03, OP_LOAD_FP = 0x07, OP_IMM = 0x13, OP_STORE = 0x23, OP_STORE_FP = 0x27,
+  OP_OP = 0x33, OP_LUI = 0x37, OP_BRANCH = 0x63, OP_JALR = 0x67, OP_JAL = 0x6f, OP_SYSTEM = 0x73,
+};
+
+#define ENC_R(f7, rs2, rs1, f3, rd, op) \
+  ((f7) << 25 | (rs2) << 20 | (rs1) << 15 | (f3) << 12 | (rd) << 7 | (op))
+#define ENC_I(imm, rs1, f3, rd, op) \
+  (BITS(imm, 11, 0) << 20 | (rs1) << 15 | (f3) << 12 | (rd) << 7 | (op))
+#define ENC_S(imm, rs2, rs1, f3, op) \
+  (BITS(imm, 11, 5) << 25 | (rs2) << 20 | (rs1) << 15 | (f3) << 12 | BITS(imm, 4, 0) << 7 | (op))
+#define ENC_B(imm, rs2, rs1, f3, op) \
+  (BITS(imm, 12, 12) << 31 | BITS(imm, 10, 5) << 25 | (rs2) << 20 | (rs1) << 15 | (f3) << 12 | \
+   BITS(imm, 4, 1) << 8 | BITS(imm, 11, 11) << 7 | (op))
+#define ENC_U(imm, rd, op) ((BITS(imm, 31, 12) << 12) | (rd) << 7 | (op))
+#define ENC_J(imm, rd, op) \
+  (BITS(imm, 20, 20) << 31 | BITS(imm, 10, 1) << 21 | BITS(imm, 11, 11) << 20 | \
+   BITS(imm, 19, 12) << 12 | (rd) << 7 | (op))
+
+#define C(hi, lo) BITS(c, hi, lo)
+// the 3-bit register fields of the compressed formats
+#define RD_  (C(4, 2) + 8)
+#define RS1_ (C(9, 7) + 8)
+#define RS2_ RD_
+
+// the immediates
+#define IMM_CI    ((uint32_t)SEXT(C(12, 12) << 5 | C(6, 2), 6))
+#define UIMM_CLW  (C(12, 10) << 3 | C(6, 6) << 2 | C(5, 5) << 6)
+#define UIMM_CLD  (C(12, 10) << 3 | C(6, 5) << 6)
+#define UIMM_LWSP (C(12, 12) << 5 | C(6, 4) << 2 | C(3, 2) << 6)
+#define UIMM_LDSP (C(12, 12) << 5 | C(6, 5) << 3 | C(4, 2) << 6)
+#define UIMM_SWSP (C(12, 9) << 2 | C(8, 7) << 6)
+#define UIMM_SDSP (C(12, 10) << 3 | C(9, 7) << 6)
+#define IMM_CJ    ((uint32_t)SEXT(C(12, 12) << 11 | C(11, 11) << 4 | C(10, 9) << 8 | C(8, 8) << 10 | \
+                   C(7, 7) << 6 | C(6, 6) << 7 | C(5, 3) << 1 | C(2, 2) << 5, 12))
+#define IMM_CB    ((uint32_t)SEXT(C(12, 12) << 8 | C(11, 10) << 3 | C(6, 5) << 6 | C(4, 3) << 1 | \
+                   C(2, 2) << 5, 9))
+
+static uint32_t expand_q0(uint32_t c) {
+  switch (C(15, 13)) {
+    case 0: { // c.addi4spn
+      uint32_t imm = C(12, 11) << 4 | C(10, 7) << 6 | C(6, 6) << 2 | C(5, 5) << 3;
+      return imm == 0 ? 0 : ENC_I(imm, 2, 0, RD_, OP_IMM);
+    }
+    case 1: return ENC_I(UIMM_CLD, RS1_, 3, RD_, OP_LOAD_FP);   // c.fld
+    case 2: return ENC_I(UIMM_CLW, RS1_, 2, RD_, OP_LOAD);      // c.lw
+    case 3: return ENC_I(UIMM_CLW, RS1_, 2, RD_, OP_LOAD_FP);   // c.flw
+    case 5: return ENC_S(UIMM_CLD, RS2_, RS1_, 3, OP_STORE_FP); // c.fsd
+    case 6: return ENC_S(UIMM_CLW, RS2_, RS1_, 2, OP_STORE);    // c.sw
+    case 7: return ENC_S(UIMM_CLW, RS2_, RS1_, 2, OP_STORE_FP); // c.fsw
+    default: return 0;
+  }
+}
+
+static uint32_t expand_q1(uint32_t c) {
+  uint32_t rd = C(11, 7);
+  switch (C(15, 13)) {
+    case 0: return ENC_I(IMM_CI, rd, 0, rd, OP_IMM);  // c.addi
+    case 1: return ENC_J(IMM_CJ, 1, OP_JAL);          // c.jal
+    case 2: return ENC_I(IMM_CI, 0, 0, rd, OP_IMM);   // c.li
+    case 3:
+      if (rd == 2) { // c.addi16sp
+        uint32_t imm = SEXT(C(12, 12) << 9 | C(6, 6) << 4 | C(5, 5) << 6 | C(4, 3) << 7 | C(2, 2) << 5, 10);
+        return imm == 0 ? 0 : ENC_I(imm, 2, 0, 2, OP_IMM);
+      }
+      // c.lui
+      return IMM_CI == 0 ? 0 : ENC_U(IMM_CI << 12, rd, OP_LUI);
+    case 4: {
+      uint32_t rd_ = RS1_;
+      switch (C(11, 10)) {
+        case 0: return C(12, 12) ? 0 : ENC_R(0x00, C(6, 2), rd_, 5, rd_, OP_IMM); // c.srli
+        case 1: return C(12, 12) ? 0 : ENC_R(0x20, C(6, 2), rd_, 5, rd_, OP_IMM); // c.srai
+        case 2: return ENC_I(IMM_CI, rd_, 7, rd_, OP_IMM);                        // c.andi
+        default:
+          if (C(12, 12)) return 0; // c.subw and c.addw of RV64
+          switch (C(6, 5)) {
+            case 0:  return ENC_R(0x20, RS2_, rd_, 0, rd_, OP_OP); // c.sub
+            case 1:  return ENC_R(0x00, RS2_, rd_, 4, rd_, OP_OP); // c.xor
+            case 2:  return ENC_R(0x00, RS2_, rd_, 6, rd_, OP_OP); // c.or
+            default: return ENC_R(0x00, RS2_, rd_, 7, rd_, OP_OP); // c.and
+          }
+      }
+    }
+    case 5: return ENC_J(IMM_CJ, 0, OP_JAL);               // c.j
+    case 6: return ENC_B(IMM_CB, 0, RS1_, 0, OP_BRANCH);   // c.beqz
+    default: return ENC_B(IMM_CB, 0, RS1_, 1, OP_BRANCH);  // c.bnez
+  }
+}
+
+static uint32_t expand_q2(uint32_t c) {
+  uint32_t rd = C(11, 7), rs2 = C(6, 2);
+  switch (C(15, 13)) {
+    case 0: return C(12, 12) ? 0 : ENC_R(0x00, rs2, rd, 1, rd, OP_IMM); // c.slli
+    case 1: return ENC_I(UIMM_LDSP, 2, 3, rd, OP_LOAD_FP);               // c.fldsp
+    case 2: return rd == 0 ? 0 : ENC_I(UIMM_LWSP, 2, 2, rd, OP_LOAD);    // c.lwsp
+    case 3: return ENC_I(UIMM_LWSP, 2, 2, rd, OP_LOAD_FP);               // c.flwsp
+    case 4:
+      if (C(12, 12) == 0) {
+        if (rs2 != 0) return ENC_R(0, rs2, 0, 0, rd, OP_OP);     // c.mv
+        return rd == 0 ? 0 : ENC_I(0, rd, 0, 0, OP_JALR);         // c.jr
+      }
+      if (rs2 != 0) return ENC_R(0, rs2, rd, 0, rd, OP_OP);      // c.add
+      if (rd == 0) return ENC_I(1, 0, 0, 0, OP_SYSTEM);           // c.ebreak
+      return ENC_I(0, rd, 0, 1, OP_JALR);                         // c.jalr
+    case 5: return ENC_S(UIMM_SDSP, rs2, 2, 3, OP_STORE_FP);     // c.fsdsp
+    case 6: return ENC_S(UIMM_SWSP, rs2, 2, 2, OP_STORE);        // c.swsp
+    default: return ENC_S(UIMM_SWSP, rs2, 2, 2, OP_STORE_FP);    // c.fswsp
+  }
+}
+
+uint32_t rvc_table[1 << 16] = {};
+
+void init_rvc() {
+  // the table is shared by the machines, see CONFIG_MULTI_INSTANCE
+  static int state = 0; // 0: empty, 1: filling, 2: ready
+  int empty = 0;
+  if (!__atomic_compare_exchange_n(&state, &empty, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) ;
+    return;
+  }
+  for (uint32_t c = 0; c < (1 << 16); c ++) {
+    switch (c & 0x3) {
+      case 0: rvc_table[c] = (c == 0 ? 0 : expand_q0(c)); break;
+      case 1: rvc_table[c] = expand_q1(c); break;
+      case 2: rvc_table[c] = expand_q2(c); break;
+      default: rvc_table[c] = 0; break; // not compressed
+    }
+  }
+  __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+}
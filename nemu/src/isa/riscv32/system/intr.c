@@ -14,6 +14,11 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
+#include "../local-include/reg.h"
+#ifdef CONFIG_DEVICE
+#include <device/intr.h>
+#endif
 
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
     /* TODO: Trigger an interrupt/exception with ``NO''.
@@ -25,12 +30,47 @@ word_t isa_raise_intr(word_t NO, vaddr_t epc) {
         // if interpret is "fault", you don't need to add 4.
         epc += 4;
     }
+    HPM_COUNT(trap);
     cpu.csr.mcause = NO;
     cpu.csr.mepc = epc;
 
+    // save MIE to MPIE and disable interrupts in the handler
+    word_t mstatus = cpu.csr.mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE);
+    if (cpu.csr.mstatus & MSTATUS_MIE) mstatus |= MSTATUS_MPIE;
+    cpu.csr.mstatus = mstatus;
+
     return cpu.csr.mtvec;
 }
 
 word_t isa_query_intr() {
+#ifdef CONFIG_DEVICE
+    // move the interrupts raised by devices to mip, which all go to hart 0
+    if (g_hartid == 0 && g_dev_intr) {
+        uint32_t dev_intr = __atomic_exchange_n(&g_dev_intr, 0, __ATOMIC_SEQ_CST);
+        if (dev_intr & (1u << DEV_INTR_TIMER)) cpu.csr.mip |= MIP_MTIP;
+        if (dev_intr & (1u << DEV_INTR_EXTERNAL)) cpu.csr.mip |= MIP_MEIP;
+    }
+#ifdef CONFIG_HAS_IPI
+    // MSIP follows the pending bit of the hart in the IPI controller
+    if (dev_ipi_pending(g_hartid)) cpu.csr.mip |= MIP_MSIP;
+    else cpu.csr.mip &= ~MIP_MSIP;
+#endif
+#endif
+    if (!(cpu.csr.mstatus & MSTATUS_MIE)) return INTR_EMPTY;
+
+    // interrupts are taken once, so the pending bit is cleared here,
+    // except MSIP which is cleared by the guest through the IPI controller
+    word_t pending = cpu.csr.mip & cpu.csr.mie;
+    if (pending & MIP_MEIP) {
+        cpu.csr.mip &= ~MIP_MEIP;
+        return IRQ(11);
+    }
+    if (pending & MIP_MSIP) {
+        return IRQ(3);
+    }
+    if (pending & MIP_MTIP) {
+        cpu.csr.mip &= ~MIP_MTIP;
+        return IRQ(7);
+    }
     return INTR_EMPTY;
 }
@@ -18,15 +18,18 @@
 #include <device/mmio.h>
 #include <isa.h>
 
+#ifdef CONFIG_PMEM_HUGEPAGE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #if   defined(CONFIG_PMEM_MALLOC)
-static uint8_t *pmem = NULL;
+MACHINE_LOCAL uint8_t *pmem = NULL;
 #else // CONFIG_PMEM_GARRAY
-static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
+uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
-uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
-paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
-
 static word_t pmem_read(paddr_t addr, int len) {
   word_t ret = host_read(guest_to_host(addr), len);
   IFDEF(CONFIG_MTRACE, Log("address = " FMT_PADDR " read " FMT_PADDR " at pc = " FMT_WORD, addr, ret, cpu.pc));
@@ -35,32 +38,107 @@ static word_t pmem_read(paddr_t addr, int len) {
 
 static void pmem_write(paddr_t addr, int len, word_t data) {
   host_write(guest_to_host(addr), len, data);
+  pmem_code_check(addr, len);
   IFDEF(CONFIG_MTRACE, Log("address = " FMT_PADDR " write " FMT_PADDR " at pc = " FMT_WORD, addr, data, cpu.pc));
 }
 
+#ifdef CONFIG_SMC_DETECT
+MACHINE_LOCAL uint8_t pmem_code[CONFIG_MSIZE >> PMEM_PAGE_SHIFT] = {};
+
+// drop the cached instructions in the pages written
+void pmem_code_written(paddr_t addr, int len) {
+  extern void dcache_invalidate(paddr_t page);
+  paddr_t first = (addr - CONFIG_MBASE) >> PMEM_PAGE_SHIFT;
+  paddr_t last = (addr + len - 1 - CONFIG_MBASE) >> PMEM_PAGE_SHIFT;
+  for (paddr_t i = first; i <= last; i++) {
+    if (pmem_code[i]) {
+      pmem_code[i] = 0;
+      dcache_invalidate(CONFIG_MBASE + (i << PMEM_PAGE_SHIFT));
+    }
+  }
+}
+#endif
+
 static void out_of_bound(paddr_t addr) {
   panic("address = " FMT_PADDR " is out of bound of pmem [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
       addr, PMEM_LEFT, PMEM_RIGHT, cpu.pc);
 }
 
+#ifdef CONFIG_PMEM_HUGEPAGE
+#define HUGE_PAGE_SIZE (2ul << 20)
+
+static uint8_t *map_anonymous(size_t len, int flags) {
+  uint8_t *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return (p == MAP_FAILED ? NULL : p);
+}
+
+// anonymous pages are zero as well
+static uint8_t *pmem_map() {
+#ifdef CONFIG_PMEM_HUGETLB
+  uint8_t *p = map_anonymous(CONFIG_MSIZE, MAP_HUGETLB);
+  if (p != NULL) {
+    Log("pmem is backed by explicit huge pages");
+    return p;
+  }
+  Log("No explicit huge page for pmem, use transparent huge pages");
+#endif
+  // map more to start at a huge page boundary, then unmap the rest
+  size_t len = CONFIG_MSIZE + HUGE_PAGE_SIZE;
+  uint8_t *raw = map_anonymous(len, 0);
+  Assert(raw != NULL, "Can not map %d bytes for pmem", CONFIG_MSIZE);
+  uint8_t *start = (uint8_t *)ROUNDUP(raw, HUGE_PAGE_SIZE);
+  if (start != raw) munmap(raw, start - raw);
+  if (raw + len != start + CONFIG_MSIZE) munmap(start + CONFIG_MSIZE, raw + len - (start + CONFIG_MSIZE));
+  if (madvise(start, CONFIG_MSIZE, MADV_HUGEPAGE) != 0) Log("Transparent huge pages are not available for pmem");
+  return start;
+}
+
+#ifdef CONFIG_PMEM_NUMA_LOCAL
+#define MPOL_PREFERRED 1
+
+// called before pmem is touched, since pages are placed on the first touch
+static void pmem_bind_local_node() {
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= 64) return;
+  unsigned long mask = 1ul << node;
+  if (syscall(SYS_mbind, pmem, CONFIG_MSIZE, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0) == 0) {
+    Log("pmem prefers NUMA node %u", node);
+  }
+}
+#endif
+#endif
+
 void init_mem() {
 #if   defined(CONFIG_PMEM_MALLOC)
-  pmem = malloc(CONFIG_MSIZE);
+#ifdef CONFIG_PMEM_HUGEPAGE
+  pmem = pmem_map();
+  IFDEF(CONFIG_PMEM_NUMA_LOCAL, pmem_bind_local_node());
+#else
+  // zeroed pages, which the image loader relies on
+  pmem = calloc(1, CONFIG_MSIZE);
   assert(pmem);
+#endif
 #endif
   IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
+#ifdef CONFIG_MULTI_INSTANCE
+void free_mem() {
+  MUXDEF(CONFIG_PMEM_HUGEPAGE, munmap(pmem, CONFIG_MSIZE), free(pmem));
+  pmem = NULL;
+}
+#endif
+
 word_t paddr_read(paddr_t addr, int len) {
-  if (likely(in_pmem(addr))) return pmem_read(addr, len);
+  if (likely(in_pmem_range(addr, len))) return pmem_read(addr, len);
   IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
   out_of_bound(addr);
   return 0;
 }
 
 void paddr_write(paddr_t addr, int len, word_t data) {
-  if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
+  if (likely(in_pmem_range(addr, len))) { pmem_write(addr, len, data); return; }
   IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
   out_of_bound(addr);
 }
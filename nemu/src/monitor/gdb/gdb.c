@@ -0,0 +1,305 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/breakpoint.h>
+#include <memory/paddr.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* A stub of the GDB remote serial protocol. Only a single thread is
+ * reported, whose registers are the general purpose registers followed
+ * by the PC. Memory packets are served from the physical memory directly.
+ */
+
+#define PACKET_SIZE 0x4000
+// instructions executed between two checks of the interrupt request from gdb
+#define CONT_BATCH 0x100000
+#define NR_GPR ARRLEN(cpu.gpr)
+
+static int conn = -1;
+static bool no_ack = false, detached = false;
+static char pkt[PACKET_SIZE + 1];
+static char reply[PACKET_SIZE + 1];
+
+static uint8_t rbuf[4096];
+static int rlen = 0, rpos = 0;
+
+static int gdb_getc() {
+  if (rpos == rlen) {
+    rlen = read(conn, rbuf, sizeof(rbuf));
+    rpos = 0;
+    if (rlen <= 0) { rlen = 0; return -1; }
+  }
+  return rbuf[rpos ++];
+}
+
+static bool gdb_has_input() {
+  if (rpos < rlen) return true;
+  struct pollfd p = { .fd = conn, .events = POLLIN };
+  return poll(&p, 1, 0) > 0;
+}
+
+static void gdb_write(const char *buf, int len) {
+  while (len > 0) {
+    int ret = write(conn, buf, len);
+    if (ret <= 0) return;
+    buf += ret;
+    len -= ret;
+  }
+}
+
+static int hex2int(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static const char hexchar[] = "0123456789abcdef";
+
+// receive a packet into `pkt', return false if the connection is closed
+static bool recv_packet() {
+  while (true) {
+    int c;
+    do {
+      c = gdb_getc();
+      if (c < 0) return false;
+    } while (c != '$');
+
+    int len = 0;
+    uint8_t sum = 0;
+    while ((c = gdb_getc()) != '#') {
+      if (c < 0) return false;
+      if (len < PACKET_SIZE) pkt[len ++] = c;
+      sum += c;
+    }
+    pkt[len] = '\0';
+    int hi = hex2int(gdb_getc()), lo = hex2int(gdb_getc());
+    if (no_ack) return true;
+    if (hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum) {
+      gdb_write("+", 1);
+      return true;
+    }
+    gdb_write("-", 1);
+  }
+}
+
+static void send_packet(const char *data) {
+  static char buf[PACKET_SIZE + 5];
+  int len = strlen(data);
+  uint8_t sum = 0;
+  buf[0] = '$';
+  for (int i = 0; i < len; i ++) {
+    buf[i + 1] = data[i];
+    sum += data[i];
+  }
+  buf[len + 1] = '#';
+  buf[len + 2] = hexchar[sum >> 4];
+  buf[len + 3] = hexchar[sum & 0xf];
+  while (true) {
+    gdb_write(buf, len + 4);
+    if (no_ack) return;
+    int c = gdb_getc();
+    if (c != '-') return;
+  }
+}
+
+// registers and memory are sent in the byte order of the guest
+static char *put_hex(char *p, const void *data, int len) {
+  const uint8_t *d = data;
+  for (int i = 0; i < len; i ++) {
+    *p ++ = hexchar[d[i] >> 4];
+    *p ++ = hexchar[d[i] & 0xf];
+  }
+  *p = '\0';
+  return p;
+}
+
+static const char *get_hex(const char *p, void *data, int len) {
+  uint8_t *d = data;
+  for (int i = 0; i < len; i ++) {
+    int hi = hex2int(p[0]), lo = hex2int(p[1]);
+    if (hi < 0 || lo < 0) return NULL;
+    d[i] = (hi << 4) | lo;
+    p += 2;
+  }
+  return p;
+}
+
+static word_t *reg_ptr(int idx) {
+  if (idx < NR_GPR) return &cpu.gpr[idx];
+  if (idx == NR_GPR) return &cpu.pc;
+  return NULL;
+}
+
+static bool mem_range_ok(paddr_t addr, word_t len) {
+  return len > 0 && in_pmem(addr) && in_pmem(addr + len - 1) && addr + len - 1 >= addr;
+}
+
+static const char *stop_reply(int sig) {
+  static char buf[16];
+  switch (nemu_state.state) {
+    case NEMU_END: sprintf(buf, "W%02x", nemu_state.halt_ret & 0xff); break;
+    case NEMU_ABORT: case NEMU_QUIT: strcpy(buf, "X06"); break;
+    default: sprintf(buf, "S%02x", sig);
+  }
+  return buf;
+}
+
+#define SIGINT  2
+#define SIGTRAP 5
+
+static int resume(bool step) {
+  if (step) {
+    cpu_exec(1);
+    return SIGTRAP;
+  }
+  while (true) {
+    cpu_exec(CONT_BATCH);
+    if (nemu_state.state != NEMU_STOP) return SIGTRAP;
+    if (bp_check(cpu.pc)) return SIGTRAP;
+    if (gdb_has_input()) {
+      // any byte received from gdb while running is treated as an interrupt
+      gdb_getc();
+      return SIGINT;
+    }
+  }
+}
+
+// handle a packet, return false to close the connection
+static bool handle_packet() {
+  char *p = pkt + 1;
+  word_t addr, len;
+  reply[0] = '\0';
+
+  switch (pkt[0]) {
+    case '?': strcpy(reply, stop_reply(SIGTRAP)); break;
+    case 'g': {
+      char *q = reply;
+      for (int i = 0; i <= NR_GPR; i ++) q = put_hex(q, reg_ptr(i), sizeof(word_t));
+      break;
+    }
+    case 'G':
+      for (int i = 0; i <= NR_GPR && p != NULL && *p != '\0'; i ++) p = (char *)get_hex(p, reg_ptr(i), sizeof(word_t));
+      strcpy(reply, "OK");
+      break;
+    case 'p': {
+      word_t *r = reg_ptr(strtol(p, NULL, 16));
+      if (r == NULL) strcpy(reply, "E01");
+      else put_hex(reply, r, sizeof(word_t));
+      break;
+    }
+    case 'P': {
+      char *eq;
+      word_t *r = reg_ptr(strtol(p, &eq, 16));
+      if (r == NULL || *eq != '=' || get_hex(eq + 1, r, sizeof(word_t)) == NULL) strcpy(reply, "E01");
+      else strcpy(reply, "OK");
+      break;
+    }
+    case 'm':
+      addr = strtoul(p, &p, 16);
+      len = (*p == ',' ? strtoul(p + 1, NULL, 16) : 0);
+      if (len > PACKET_SIZE / 2) len = PACKET_SIZE / 2;
+      if (!mem_range_ok(addr, len)) strcpy(reply, "E14");
+      else put_hex(reply, guest_to_host(addr), len);
+      break;
+    case 'M':
+      addr = strtoul(p, &p, 16);
+      len = (*p == ',' ? strtoul(p + 1, &p, 16) : 0);
+      if (*p != ':' || !mem_range_ok(addr, len)) strcpy(reply, "E14");
+      else {
+        pmem_code_check(addr, len); // the cached code there is decoded again
+        strcpy(reply, get_hex(p + 1, guest_to_host(addr), len) == NULL ? "E01" : "OK");
+      }
+      break;
+    case 'c': case 's':
+      if (*p != '\0') cpu.pc = strtoul(p, NULL, 16);
+      strcpy(reply, stop_reply(resume(pkt[0] == 's')));
+      break;
+    case 'Z': case 'z':
+      // software and hardware breakpoints are the same for NEMU
+      if (p[0] != '0' && p[0] != '1') break;
+      addr = strtoul(p + 2, NULL, 16);
+      if (pkt[0] == 'Z') bp_insert(addr);
+      else bp_remove(addr);
+      strcpy(reply, "OK");
+      break;
+    case 'v':
+      if (strcmp(p, "Cont?") == 0) strcpy(reply, "vCont;c;C;s;S");
+      else if (strncmp(p, "Cont;", 5) == 0) {
+        // there is only one thread, so the first action applies to it
+        char action = p[5];
+        if (action == 'c' || action == 'C' || action == 's' || action == 'S') {
+          strcpy(reply, stop_reply(resume(action == 's' || action == 'S')));
+        }
+      }
+      break;
+    case 'q':
+      if (strncmp(p, "Supported", 9) == 0) {
+        sprintf(reply, "PacketSize=%x;vContSupported+;QStartNoAckMode+", PACKET_SIZE);
+      }
+      else if (strcmp(p, "Attached") == 0) strcpy(reply, "1");
+      else if (strcmp(p, "C") == 0) strcpy(reply, "QC1");
+      else if (strcmp(p, "fThreadInfo") == 0) strcpy(reply, "m1");
+      else if (strcmp(p, "sThreadInfo") == 0) strcpy(reply, "l");
+      break;
+    case 'Q':
+      if (strcmp(p, "StartNoAckMode") == 0) {
+        send_packet("OK");
+        no_ack = true;
+        return true;
+      }
+      break;
+    case 'H': case 'T': strcpy(reply, "OK"); break;
+    case 'D': send_packet("OK"); detached = true; return false;
+    case 'k': nemu_state.state = NEMU_QUIT; return false;
+  }
+
+  send_packet(reply);
+  // the guest has finished, nothing can be done with this connection
+  return pkt[0] == '?' || (reply[0] != 'W' && reply[0] != 'X');
+}
+
+void gdb_mainloop(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  Assert(fd >= 0, "can not create socket");
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  Assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "can not bind to port %d", port);
+  Assert(listen(fd, 1) == 0, "can not listen at port %d", port);
+
+  Log("Waiting for gdb to connect at localhost:%d", port);
+  conn = accept(fd, NULL, NULL);
+  close(fd);
+  Assert(conn >= 0, "can not accept the connection from gdb");
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  Log("gdb connected");
+
+  while (recv_packet() && handle_packet());
+
+  close(conn);
+  if (detached) {
+    // let the guest run to the end without gdb
+    cpu_exec(-1);
+  } else if (nemu_state.state == NEMU_STOP) nemu_state.state = NEMU_QUIT;
+}
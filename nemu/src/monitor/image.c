@@ -0,0 +1,157 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <elf.h>
+#include <zlib.h>
+
+/* An image is either a raw binary loaded at RESET_VECTOR, or an ELF file
+ * whose PT_LOAD segments are placed at their physical addresses. Either
+ * may be compressed by gzip. zlib also reads plain files, so an image is
+ * always read as a stream into pmem, and never decompressed as a whole.
+ */
+
+#ifdef CONFIG_ISA64
+typedef Elf64_Ehdr Ehdr;
+typedef Elf64_Phdr Phdr;
+#define ELF_CLASS ELFCLASS64
+#else
+typedef Elf32_Ehdr Ehdr;
+typedef Elf32_Phdr Phdr;
+#define ELF_CLASS ELFCLASS32
+#endif
+
+// see the built-in image of restart()
+#define BUILTIN_IMG_SIZE 4096
+
+static const char *img_name = NULL;
+
+static void img_read(gzFile fp, void *dst, size_t len) {
+  uint8_t *buf = (uint8_t *)dst;
+  while (len > 0) {
+    unsigned n = (len > (1u << 30) ? (1u << 30) : len);
+    int ret = gzread(fp, buf, n);
+    Assert(ret == n, "Can not read %u bytes from '%s'", n, img_name);
+    buf += n;
+    len -= n;
+  }
+}
+
+// a truncated gzip stream is only reported by gzerror()
+static void img_check(gzFile fp) {
+  int err;
+  const char *msg = gzerror(fp, &err);
+  Assert(err == Z_OK, "Can not read '%s': %s", img_name, msg);
+}
+
+static void img_seek(gzFile fp, long offset) {
+  Assert(gzseek(fp, offset, SEEK_SET) == offset, "Can not seek to %ld in '%s'", offset, img_name);
+}
+
+static void zero_bss(paddr_t addr, size_t len) {
+#ifndef CONFIG_MEM_RANDOM
+  /* pmem is zero except the built-in image, so only the bss over the image
+   * is cleared, and the pages of the other bss are never touched. */
+  paddr_t end = addr + len;
+  if (addr >= RESET_VECTOR + BUILTIN_IMG_SIZE || end <= RESET_VECTOR) return;
+  if (addr < RESET_VECTOR) addr = RESET_VECTOR;
+  if (end > RESET_VECTOR + BUILTIN_IMG_SIZE) end = RESET_VECTOR + BUILTIN_IMG_SIZE;
+  len = end - addr;
+#endif
+  memset(guest_to_host(addr), 0, len);
+}
+
+static int phdr_cmp(const void *a, const void *b) {
+  const Phdr *pa = (const Phdr *)a, *pb = (const Phdr *)b;
+  return (pa->p_offset > pb->p_offset) - (pa->p_offset < pb->p_offset);
+}
+
+static long load_elf(gzFile fp, const Ehdr *eh) {
+  Assert(eh->e_ident[EI_CLASS] == ELF_CLASS && eh->e_phentsize == sizeof(Phdr),
+      "'%s' is not an ELF file of " MUXDEF(CONFIG_ISA64, "64", "32") " bits", img_name);
+  Phdr *ph = (Phdr *)malloc(sizeof(Phdr) * eh->e_phnum);
+  assert(ph);
+  img_seek(fp, eh->e_phoff);
+  img_read(fp, ph, sizeof(Phdr) * eh->e_phnum);
+
+  // read the segments in the order of the file to avoid seeking backward
+  qsort(ph, eh->e_phnum, sizeof(Phdr), phdr_cmp);
+  paddr_t img_end = RESET_VECTOR;
+  for (int i = 0; i < eh->e_phnum; i ++) {
+    Phdr *p = &ph[i];
+    if (p->p_type != PT_LOAD || p->p_memsz == 0) continue;
+    Assert(p->p_filesz <= p->p_memsz && in_pmem_range(p->p_paddr, p->p_memsz),
+        "segment [" FMT_PADDR ", " FMT_PADDR ") of '%s' is out of pmem",
+        (paddr_t)p->p_paddr, (paddr_t)(p->p_paddr + p->p_memsz), img_name);
+    Log("Load segment [" FMT_PADDR ", " FMT_PADDR "), file size = %ld",
+        (paddr_t)p->p_paddr, (paddr_t)(p->p_paddr + p->p_memsz), (long)p->p_filesz);
+    img_seek(fp, p->p_offset);
+    img_read(fp, guest_to_host(p->p_paddr), p->p_filesz);
+    zero_bss(p->p_paddr + p->p_filesz, p->p_memsz - p->p_filesz);
+    if (p->p_paddr + p->p_memsz > img_end) img_end = p->p_paddr + p->p_memsz;
+  }
+  free(ph);
+
+  if (eh->e_entry != RESET_VECTOR) {
+    Log("The entry is " FMT_WORD, (word_t)eh->e_entry);
+    cpu.pc = eh->e_entry;
+  }
+  return img_end - RESET_VECTOR;
+}
+
+static long load_bin(gzFile fp, const void *head, size_t head_len) {
+  size_t max = PMEM_RIGHT - RESET_VECTOR + 1;
+  uint8_t *dst = guest_to_host(RESET_VECTOR);
+  memcpy(dst, head, head_len);
+  size_t size = head_len;
+  int ret = 0;
+  while (size < max && (ret = gzread(fp, dst + size, (max - size > (1u << 30) ? (1u << 30) : max - size))) > 0) {
+    size += ret;
+  }
+  Assert(ret >= 0, "Can not read '%s'", img_name);
+  char c;
+  ret = gzread(fp, &c, 1);
+  Assert(ret >= 0, "Can not read '%s'", img_name);
+  img_check(fp);
+  Assert(ret == 0, "'%s' is larger than pmem", img_name);
+  return size;
+}
+
+long load_img(const char *file) {
+  if (file == NULL) {
+    Log("No image is given. Use the default build-in image.");
+    return BUILTIN_IMG_SIZE;
+  }
+
+  img_name = file;
+  gzFile fp = gzopen(file, "rb");
+  Assert(fp, "Can not open '%s'", file);
+  gzbuffer(fp, 1 << 20);
+
+  Ehdr eh;
+  int len = gzread(fp, &eh, sizeof(eh));
+  Assert(len >= 0, "Can not read '%s'", file);
+  bool is_elf = (len == sizeof(eh) && memcmp(eh.e_ident, ELFMAG, SELFMAG) == 0);
+  bool is_gz = !gzdirect(fp);
+  long size = (is_elf ? load_elf(fp, &eh) : load_bin(fp, &eh, len));
+  img_check(fp);
+
+  Log("The image is %s, size = %ld%s%s", file, size,
+      (is_elf ? ", ELF" : ""), (is_gz ? ", gzip" : ""));
+
+  gzclose(fp);
+  return size;
+}
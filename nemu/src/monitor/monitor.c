@@ -22,6 +22,7 @@ void init_mem();
 void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
+void init_sdb_stdout();
 void init_disasm(const char *triple);
 
 static void welcome() {
@@ -38,6 +39,10 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_gdb_mode(int port);
+void sdb_set_expr_test(const char *file);
+void sdb_set_script(const char *file);
+void sdb_set_dump(const char *file, const char *format);
 extern void load_elf_and_parse(const char *elf_file);
 
 static char *log_file = NULL;
@@ -46,28 +51,90 @@ static char *img_file = NULL;
 static char *elf_file = NULL;
 static int difftest_port = 1234;
 
-static long load_img() {
-  if (img_file == NULL) {
-    Log("No image is given. Use the default build-in image.");
-    return 4096; // built-in image size
-  }
+// see image.c
+long load_img(const char *file);
+
+#ifdef CONFIG_MULTI_INSTANCE
+#include <cpu/cpu.h>
+#include <pthread.h>
 
-  FILE *fp = fopen(img_file, "rb");
-  Assert(fp, "Can not open '%s'", img_file);
+void free_mem();
+void free_map();
+void serial_flush();
+int is_exit_status_bad();
 
-  fseek(fp, 0, SEEK_END);
-  long size = ftell(fp);
+/* With `--multi=N', every image given is run in batch mode by one of the
+ * N workers. Each image gets a new thread, so the thread-local state of
+ * the machine (see MACHINE_LOCAL) starts from its initial value.
+ */
+static int multi_jobs = 0;
+static char **multi_img = NULL;
+static int nr_multi_img = 0;
+static int multi_next = 0;
+static int multi_nr_bad = 0;
+static MACHINE_LOCAL bool is_machine = false;
 
-  Log("The image is %s, size = %ld", img_file, size);
+static void machine_free() {
+  IFDEF(CONFIG_HAS_SERIAL, serial_flush());
+  IFDEF(CONFIG_DEVICE, free_map());
+  free_mem();
+}
 
-  fseek(fp, 0, SEEK_SET);
-  int ret = fread(guest_to_host(RESET_VECTOR), size, 1, fp);
-  assert(ret == 1);
+// called by Assert() to stop the failing machine instead of the whole process
+void machine_abort() {
+  if (!is_machine) abort();
+  nemu_state.state = NEMU_ABORT;
+  machine_free();
+  pthread_exit(NULL);
+}
 
-  fclose(fp);
-  return size;
+static void *machine_main(void *file) {
+  is_machine = true;
+  init_mem();
+  IFDEF(CONFIG_DEVICE, init_device());
+  init_isa();
+  load_img(file);
+  cpu_exec(-1);
+  bool good = !is_exit_status_bad();
+  machine_free();
+  return good ? file : NULL;
 }
 
+static void *multi_worker(void *arg) {
+  int i;
+  while ((i = __atomic_fetch_add(&multi_next, 1, __ATOMIC_RELAXED)) < nr_multi_img) {
+    pthread_t t;
+    void *ret = NULL;
+    int r = pthread_create(&t, NULL, machine_main, multi_img[i]);
+    Assert(r == 0, "Can not create the thread for '%s'", multi_img[i]);
+    pthread_join(t, &ret);
+    if (ret == NULL) {
+      __atomic_fetch_add(&multi_nr_bad, 1, __ATOMIC_RELAXED);
+      Log("%s: " ANSI_FMT("FAIL", ANSI_FG_RED), multi_img[i]);
+    }
+  }
+  return NULL;
+}
+
+bool multi_mainloop() {
+  if (nr_multi_img == 0) return false;
+  int n = (multi_jobs < nr_multi_img ? multi_jobs : nr_multi_img);
+  Log("Run %d images with %d threads", nr_multi_img, n);
+  pthread_t worker[n];
+  for (int i = 0; i < n; i ++) {
+    int r = pthread_create(&worker[i], NULL, multi_worker, NULL);
+    Assert(r == 0, "Can not create worker %d", i);
+  }
+  for (int i = 0; i < n; i ++) pthread_join(worker[i], NULL);
+  Log("%d of %d images fail", multi_nr_bad, nr_multi_img);
+
+  // report the result through the state of the main thread
+  nemu_state.state = NEMU_END;
+  nemu_state.halt_ret = (multi_nr_bad != 0);
+  return true;
+}
+#endif
+
 static int parse_args(int argc, char *argv[]) {
   const struct option table[] = {
     {"batch"    , no_argument      , NULL, 'b'},
@@ -75,24 +142,55 @@ static int parse_args(int argc, char *argv[]) {
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
     {"elf", required_argument, NULL, 'e'},
+    {"gdb"      , required_argument, NULL, 'g'},
+    {"test-expr", required_argument, NULL, 't'},
+    {"script"   , required_argument, NULL, 's'},
+    {"dump"     , required_argument, NULL, 'o'},
+    {"dump-format", required_argument, NULL, 'f'},
+#ifdef CONFIG_MULTI_INSTANCE
+    {"multi"    , required_argument, NULL, 'm'},
+#endif
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:g:m:t:s:o:f:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
       case 'e': elf_file = optarg; break;
+      case 'g': sdb_set_gdb_mode(atoi(optarg)); break;
+      case 't': sdb_set_expr_test(optarg); break;
+      case 's': sdb_set_script(optarg); break;
+      case 'o': sdb_set_dump(optarg, NULL); break;
+      case 'f': sdb_set_dump(NULL, optarg); break;
+#ifdef CONFIG_MULTI_INSTANCE
+      case 'm':
+        multi_jobs = atoi(optarg);
+        Assert(multi_jobs > 0, "invalid number of threads: %s", optarg);
+        multi_img = malloc(sizeof(char *) * argc);
+        break;
+      case 1:
+        if (multi_jobs > 0) { multi_img[nr_multi_img ++] = optarg; break; }
+        img_file = optarg; return 0;
+#else
       case 1: img_file = optarg; return 0;
+#endif
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
         printf("\t-b,--batch              run with batch mode\n");
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-g,--gdb=PORT           wait for gdb to connect at port PORT\n");
+        printf("\t-t,--test-expr=FILE     check the expressions generated by gen-expr in FILE\n");
+        printf("\t-s,--script=FILE        run the sdb commands in FILE (- for stdin) and exit\n");
+        printf("\t-o,--dump=FILE          write the output of the dump command to FILE\n");
+        printf("\t-f,--dump-format=FMT    dump as json (the default) or bin\n");
+        IFDEF(CONFIG_MULTI_INSTANCE,
+            printf("\t-m,--multi=N            run all the IMAGEs after it with N threads\n"));
 
 #ifdef CONFIG_FTRACE
             printf("\t-e,--elf=ELF_FILE       trace the function for debug\n");
@@ -110,12 +208,31 @@ void init_monitor(int argc, char *argv[]) {
   /* Parse arguments. */
   parse_args(argc, argv);
 
+  /* Keep stdout for the dumps of a script. */
+  init_sdb_stdout();
+
   /* Set random seed. */
   init_rand();
 
   /* Open the log file. */
   init_log(log_file);
 
+#ifndef CONFIG_ISA_loongarch32r
+  IFDEF(CONFIG_ITRACE, init_disasm(
+    MUXDEF(CONFIG_ISA_x86,     "i686",
+    MUXDEF(CONFIG_ISA_mips32,  "mipsel",
+    MUXDEF(CONFIG_ISA_riscv,
+      MUXDEF(CONFIG_RV64,      "riscv64",
+                               "riscv32"),
+                               "bad"))) "-pc-linux-gnu"
+  ));
+#endif
+
+#ifdef CONFIG_MULTI_INSTANCE
+  /* The machines are initialized by their own threads. */
+  if (nr_multi_img > 0) return;
+#endif
+
   /* Initialize memory. */
   init_mem();
 
@@ -126,7 +243,7 @@ void init_monitor(int argc, char *argv[]) {
   init_isa();
 
   /* Load the image to memory. This will overwrite the built-in image. */
-  long img_size = load_img();
+  long img_size = load_img(img_file);
 
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
@@ -137,17 +254,6 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize the simple debugger. */
   init_sdb();
 
-#ifndef CONFIG_ISA_loongarch32r
-  IFDEF(CONFIG_ITRACE, init_disasm(
-    MUXDEF(CONFIG_ISA_x86,     "i686",
-    MUXDEF(CONFIG_ISA_mips32,  "mipsel",
-    MUXDEF(CONFIG_ISA_riscv,
-      MUXDEF(CONFIG_RV64,      "riscv64",
-                               "riscv32"),
-                               "bad"))) "-pc-linux-gnu"
-  ));
-#endif
-
   /* Display welcome message. */
   welcome();
 }
@@ -15,327 +15,293 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/host.h>
+#include "sdb.h"
 
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
+/* An expression is scanned once by a table-driven lexer, and parsed by
+ * precedence climbing into an AST. The AST is kept in a flat array of
+ * nodes, so that a watchpoint can evaluate it again and again without
+ * touching the string.
  */
-#include <regex.h>
-#include <stdio.h>
-#include <string.h>
 
 enum {
-    TK_NOTYPE = 65,
-    TK_EQ,
-    NUM,
-    HEX,
-    TK_UEQ,
-    REG,
-    DEREF, // 解引用
-    MINUS  // 取负
+    TK_END, TK_SPACE, TK_NUM, TK_REG, TK_LP, TK_RP,
+    TK_OR, TK_AND, TK_EQ, TK_NE, TK_ADD, TK_SUB, TK_MUL, TK_DIV,
+    TK_NEG, TK_DEREF, // only in the AST
+    TK_BAD
 };
 
-static struct rule {
-    const char *regex;
-    int token_type;
-} rules[] = {//这里面不要有字符的type，因为标识从A开始
-        {"0x[0-9A-Fa-f]+", HEX}, //16进制数字
-        {"\\$[0-9a-z]+",   REG},//寄存器
-        {"[0-9]+",         NUM},       // 数字
-        {"\\(",            '('},         // 左括号
-        {"\\)",            ')'},         // 右括号
-        {"\\+",            '+'},         // plus
-        {"\\-",            '-'},         // sub
-        {"\\*",            '*'},         // mul
-        {"\\/",            '/'},         // divide
-        {" +",             TK_NOTYPE},    // spaces
-        {"==",             TK_EQ},        // equal
-        {"!=",             TK_UEQ},
-        {"&&",             '&'},
-        {"\\|\\|",         '|'}
+// the token starting with a character, TK_BAD if none
+static const uint8_t char_token[256] = {
+        [0 ... 255] = TK_BAD,
+        ['\0'] = TK_END,
+        [' '] = TK_SPACE, ['\t'] = TK_SPACE,
+        ['0' ... '9'] = TK_NUM,
+        ['$'] = TK_REG,
+        ['('] = TK_LP, [')'] = TK_RP,
+        ['|'] = TK_OR, ['&'] = TK_AND, ['='] = TK_EQ, ['!'] = TK_NE,
+        ['+'] = TK_ADD, ['-'] = TK_SUB, ['*'] = TK_MUL, ['/'] = TK_DIV,
 };
 
-#define NR_REGEX ARRLEN(rules)
-
-static regex_t re[NR_REGEX] = {};
+// the second character of the tokens with two characters
+static const char token_2nd[TK_BAD + 1] = {
+        [TK_OR] = '|', [TK_AND] = '&', [TK_EQ] = '=', [TK_NE] = '=',
+};
 
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-    int i;
-    char error_msg[128];
-    int ret;
+// the binding power of binary operators, 0 for the others (and TK_BAD,
+// which ends the parsing after an error)
+static const uint8_t binding_power[TK_BAD + 1] = {
+        [TK_OR] = 1, [TK_AND] = 2, [TK_EQ] = 3, [TK_NE] = 3,
+        [TK_ADD] = 4, [TK_SUB] = 4, [TK_MUL] = 5, [TK_DIV] = 5,
+};
+#define PREFIX_POWER 6
 
-    for (i = 0; i < NR_REGEX; i++) {
-        ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-        if (ret != 0) {
-            regerror(ret, &re[i], error_msg, 128);
-            panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-        }
-    }
-}
+#define REG_NAME_LEN 16
 
-typedef struct token {
+typedef struct {
     int type;
-    char str[32];
-} Token;
-
-static Token tokens[2048] __attribute__((used)) = {};
-static int nr_token __attribute__((used)) = 0;
-
-int prio(int type);
-
-static bool make_token(const char *e) {
-    int position = 0;
-    int i;
-    regmatch_t pmatch;
-
-    nr_token = 0;
-
-    while (e[position] != '\0') {
-        /* Try all rules one by one. */
-        for (i = 0; i < NR_REGEX; i++) {
-            if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-                // const char *substr_start = e + position;
-                int substr_len = pmatch.rm_eo;
-
-                if (substr_len > 32) {
-                    assert(0);
-                }
-
-//                Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-//                    i, rules[i].regex, position, substr_len, substr_len, substr_start);
+    int lhs, rhs; // index of the operands
+    word_t val;
+    char reg[REG_NAME_LEN];
+} ExprNode;
+
+struct Expr {
+    int root;
+    int nr_node;
+    ExprNode node[];
+};
 
-                position += substr_len;
+typedef struct {
+    const char *e;
+    const char *p;  // the character after the current token
+    int type;       // the current token
+    const char *tok_start;
+    word_t val;
+    char reg[REG_NAME_LEN];
+    Expr *ex;
+    const char *error;
+    const char *error_pos;
+} Parser;
+
+static inline bool is_alnum(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
 
-                /* TODO: Now a new token is recognized with rules[i]. Add codes
-                 * to record the token in the array `tokens'. For certain types
-                 * of tokens, some extra actions should be performed.
-                 */
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-                switch (rules[i].token_type) {
-                    case '*':
-                    case '-':
-                        if (nr_token == 0 || tokens[nr_token - 1].type == '(' || prio(tokens[nr_token - 1].type) > 0) {
-                            switch (rules[i].token_type) {
-                                case '*':
-                                    tokens[nr_token].type = DEREF;
-                                    break;
-                                case '-':
-                                    tokens[nr_token].type = MINUS;
-                                    break;
-                            }
-                        } else if (tokens[nr_token - 1].type == ')'
-                                   || tokens[nr_token - 1].type == NUM || tokens[nr_token - 1].type == HEX
-                                   || tokens[nr_token - 1].type == REG) {
-                            tokens[nr_token].type = rules[i].token_type;
-                        } else {
-                            IFDEF(CONFIG_DEBUG, Log("遇到了%#x作为前缀", tokens[i - 1].type));
-                            assert(0);
-                        }
-                        nr_token++;
-                        break;
+static void fail(Parser *s, const char *msg, const char *pos) {
+    if (s->error == NULL) {
+        s->error = msg;
+        s->error_pos = pos;
+    }
+    s->type = TK_BAD;
+}
 
-                    case TK_NOTYPE:
-                        break;
-                    case NUM:
-                    case HEX:
-                    case REG:
-                        memcpy(tokens[nr_token].str, e + position - substr_len, (substr_len) * sizeof(char));
-                        Assert(substr_len < 32, "substr_len >= 32");
-                        tokens[nr_token].str[substr_len] = '\0';
-                        // IFDEF(CONFIG_DEBUG, Log("[DEBUG ]读入了一个数字%s", tokens[nr_token].str));
-                    default:
-                        tokens[nr_token].type = rules[i].token_type;
-                        nr_token++;
-                        break;
-                }
+static void next_token(Parser *s) {
+    const char *p = s->p;
+    int type;
+    while ((type = char_token[(uint8_t) *p]) == TK_SPACE) p++;
+    s->tok_start = p;
 
-                break;
+    switch (type) {
+        case TK_END:
+            break;
+        case TK_NUM: {
+            word_t val = 0;
+            if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hex_digit(p[2]) >= 0) {
+                for (p += 2; hex_digit(*p) >= 0; p++) val = val * 16 + hex_digit(*p);
+            } else {
+                for (; *p >= '0' && *p <= '9'; p++) val = val * 10 + (*p - '0');
             }
+            s->val = val;
+            break;
         }
-
-        if (i == NR_REGEX) {
-            printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-            return false;
+        case TK_REG: {
+            int len = 0;
+            s->reg[len++] = *p++;
+            while (is_alnum(*p)) {
+                if (len == REG_NAME_LEN - 1) {
+                    fail(s, "register name too long", s->tok_start);
+                    return;
+                }
+                s->reg[len++] = *p++;
+            }
+            s->reg[len] = '\0';
+            if (len == 1) {
+                fail(s, "register name expected", s->tok_start);
+                return;
+            }
+            break;
         }
+        case TK_BAD:
+            fail(s, "unknown character", p);
+            return;
+        default:
+            p++;
+            if (token_2nd[type] != 0 && *p++ != token_2nd[type]) {
+                fail(s, "unknown operator", s->tok_start);
+                return;
+            }
+            break;
     }
+    s->type = type;
+    s->p = p;
+}
 
-    return true;
+static int new_node(Parser *s, int type, int lhs, int rhs) {
+    ExprNode *n = &s->ex->node[s->ex->nr_node];
+    n->type = type;
+    n->lhs = lhs;
+    n->rhs = rhs;
+    return s->ex->nr_node++;
 }
 
-word_t eval(int p, int q, bool *success, int *position);
+static int parse(Parser *s, int min_power);
 
-word_t expr(const char *e, bool *success) {
-    if (!make_token(e)) {
-        *success = false;
-        return 0;
+// a number, a register, a parenthesized expression or a unary operator
+static int parse_prefix(Parser *s) {
+    int type = s->type;
+    int n;
+    switch (type) {
+        case TK_NUM:
+            n = new_node(s, TK_NUM, -1, -1);
+            s->ex->node[n].val = s->val;
+            next_token(s);
+            return n;
+        case TK_REG:
+            n = new_node(s, TK_REG, -1, -1);
+            strcpy(s->ex->node[n].reg, s->reg);
+            next_token(s);
+            return n;
+        case TK_LP:
+            next_token(s);
+            n = parse(s, 0);
+            if (s->type != TK_RP) {
+                fail(s, "')' expected", s->tok_start);
+                return -1;
+            }
+            next_token(s);
+            return n;
+        case TK_SUB:
+        case TK_MUL:
+            next_token(s);
+            n = parse(s, PREFIX_POWER);
+            return new_node(s, type == TK_SUB ? TK_NEG : TK_DEREF, n, -1);
+        default:
+            fail(s, "operand expected", s->tok_start);
+            return -1;
     }
+}
 
-    *success = true;
-    int position = 0;
-    int ans = eval(0, nr_token - 1, success, &position);
-    if (!*success) {
-        printf("some problem happens at position %d\n%s\n%*.s^\n", position, e, position, "");
+// binary operators binding no tighter than `min_power' are left to the caller
+static int parse(Parser *s, int min_power) {
+    int lhs = parse_prefix(s);
+    while (binding_power[s->type] > min_power) {
+        int op = s->type;
+        next_token(s);
+        int rhs = parse(s, binding_power[op]);
+        lhs = new_node(s, op, lhs, rhs);
     }
-    return ans;
+    return lhs;
 }
 
-#define STACK_SIZE 1024
-
-bool check_parentheses(int p, int q, int *position) {
-    //char *stack = calloc(STACK_SIZE, sizeof(char));
-    char stack[STACK_SIZE];
-    *position = -1;
-    int top = -1, index = p;
-    bool is_parentheses = tokens[p].type == '(';
-    while (index <= q) {
-        if (tokens[index].type == '(') {
-            stack[++top] = '(';
-        } else if (tokens[index].type == ')') {
-            if (top < 0 || stack[top] != '(') {
-                *position = p;
-                return false;
-            } else {
-                top--;
-            }
-        }
-        if (index < q)
-            is_parentheses = (top >= 0) && is_parentheses; // 永远都该有一个前括号
-        index++;
-    }
-    if (top != -1) { //栈空
-        *position = p;
-        return false;
+Expr *expr_compile(const char *e) {
+    // every token takes at least a character, and makes at most a node
+    int max_node = strlen(e) + 1;
+    Expr *ex = malloc(sizeof(Expr) + max_node * sizeof(ExprNode));
+    assert(ex);
+    ex->nr_node = 0;
+
+    Parser s = {.e = e, .p = e, .ex = ex};
+    next_token(&s);
+    ex->root = parse(&s, 0);
+    if (s.error == NULL && s.type != TK_END) fail(&s, "unexpected token", s.tok_start);
+    if (s.error != NULL) {
+        int pos = s.error_pos - e;
+        printf("%s at position %d\n%s\n%*.s^\n", s.error, pos, e, pos, "");
+        free(ex);
+        return NULL;
     }
-    return is_parentheses;
+    return ex;
 }
 
-#define PRIOROTY_BASE 16
+void expr_free(Expr *ex) {
+    free(ex);
+}
 
-int prio(int type) {
-    switch (type) {
-        case '|':
-            return PRIOROTY_BASE + 0;
-        case '&':
-            return PRIOROTY_BASE + 1;
-        case TK_EQ:
-        case TK_UEQ:
-            return PRIOROTY_BASE + 2;
-        case '+':
-        case '-':
-            return PRIOROTY_BASE + 3;
-        case '*':
-        case '/':
-            return PRIOROTY_BASE + 4;
+static word_t eval(const Expr *ex, int i, bool *success) {
+    const ExprNode *n = &ex->node[i];
+    word_t val1, val2;
+    bool ok;
+    switch (n->type) {
+        case TK_NUM:
+            return n->val;
+        case TK_REG:
+            if (strcmp(n->reg, "$pc") == 0) return cpu.pc;
+            // both "$0" and "$a0" are accepted
+            val1 = isa_reg_str2val(n->reg, &ok);
+            if (!ok) val1 = isa_reg_str2val(n->reg + 1, &ok);
+            if (!ok) {
+                printf("unknown register %s\n", n->reg);
+                *success = false;
+            }
+            return val1;
+        case TK_NEG:
+            return -eval(ex, n->lhs, success);
+        case TK_DEREF:
+            val1 = eval(ex, n->lhs, success);
+            if (!in_pmem(val1) || !in_pmem(val1 + 3)) {
+                printf("can not access address " FMT_WORD "\n", val1);
+                *success = false;
+                return 0;
+            }
+            return host_read(guest_to_host(val1), 4);
         default:
-            return -1;
+            break;
     }
+
+    val1 = eval(ex, n->lhs, success);
+    // && and || do not evaluate the right operand if not needed
+    if (n->type == TK_AND && !val1) return 0;
+    if (n->type == TK_OR && val1) return 1;
+    val2 = eval(ex, n->rhs, success);
+    switch (n->type) {
+        case TK_OR:  return val2 != 0;
+        case TK_AND: return val2 != 0;
+        case TK_EQ:  return val1 == val2;
+        case TK_NE:  return val1 != val2;
+        case TK_ADD: return val1 + val2;
+        case TK_SUB: return val1 - val2;
+        case TK_MUL: return val1 * val2;
+        case TK_DIV:
+            if (val2 == 0) {
+                puts("division by zero");
+                *success = false;
+                return 0;
+            }
+            return val1 / val2;
+        default: panic("bad node type %d", n->type);
+    }
+}
+
+word_t expr_eval(const Expr *ex, bool *success) {
+    *success = true;
+    word_t val = eval(ex, ex->root, success);
+    return *success ? val : 0;
 }
 
-u_int32_t eval(int p, int q, bool *success, int *position) {
-    if (p > q) {
+word_t expr(const char *e, bool *success) {
+    Expr *ex = expr_compile(e);
+    if (ex == NULL) {
         *success = false;
         return 0;
-    } else if (p == q) {
-        /* Single token.
-         * For now this token should be a number.
-         * Return the value of the number.
-         */
-        u_int32_t buffer = 0;
-        switch (tokens[p].type) {
-            case HEX:
-//                sscanf(tokens[p].str, "%x", &buffer);
-                buffer = strtol(tokens[p].str, NULL, 16);
-                break;
-
-            case NUM:
-//                sscanf(tokens[p].str, "%u", &buffer);
-                buffer = strtol(tokens[p].str, NULL, 10);
-                break;
-
-            case REG:
-                if (strcmp(tokens[p].str, "$pc") == 0) {
-                    buffer = cpu.pc;
-                    *success = true;
-                } else {
-                    buffer = isa_reg_str2val(tokens[p].str, success);
-                }
-
-                if (!*success) {
-                    *position = p;
-                    return 0;
-                }
-                break;
-
-            default:
-                assert(0);
-        }
-        // IFDEF(CONFIG_DEBUG, Log("读取数据 %d %s %x", buffer, tokens[p].str, tokens[p].type));
-        return buffer;
-    } else if (q - p == 1 || check_parentheses(p + 1, q, position) == true) {//长度为2的子表达式呈型于 -[NUM] *[NUM]
-        switch (tokens[p].type) {
-            case DEREF:
-                return *((uint32_t *) guest_to_host(eval(p + 1, q, success, position)));
-                break;
-
-            case MINUS://取负
-                return -eval(p + 1, q, success, position);
-            default:
-                assert(0);
-        }
-    } else if (check_parentheses(p, q, position) == true) {
-        /* The expression is surrounded by a matched pair of parentheses.
-         * If that is the case, just throw away the parentheses.
-         */
-        // IFDEF(CONFIG_DEBUG, Log("解括号"));
-        return eval(p + 1, q - 1, success, position);
-    } else {
-        // IFDEF(CONFIG_DEBUG, Log("计算"));
-        if (*position != -1) {
-            *success = false;
-            return 0;
-        }
-        int op = -1, level = -1;
-        for (int i = p; i <= q; ++i) {
-            if (tokens[i].type == '(') {
-                level++;
-            } else if (tokens[i].type == ')') {
-                level--;// 不再检查合法性，一定合法
-            } else if (level == -1 && prio(tokens[i].type) >= 0) {//说明层次不在括号里且是运算符
-                if (op == -1 || prio(tokens[i].type) <= prio(tokens[op].type)) {// 寻找主运算符
-                    op = i;
-                }
-            }
-        }
-        if (op == -1) {
-            *success = false;
-            *position = 0;
-            return 0;
-        }
-
-        // IFDEF(CONFIG_DEBUG, Log("主运算符 %c", tokens[op].type));
-        u_int32_t val1 = eval(p, op - 1, success, position);
-        u_int32_t val2 = eval(op + 1, q, success, position);
-        switch (tokens[op].type) {
-            case '+':
-                return val1 + val2;
-            case '-':
-                return val1 - val2;
-            case '*':
-                return val1 * val2;
-            case '/':
-                return val1 / val2;
-            case TK_EQ:
-                return val1 == val2;
-            case TK_UEQ:
-                return val1 != val2;
-            case '|':
-                return val1 || val2;
-            case '&':
-                return val1 && val2;
-            default:
-                assert(0);
-        }
     }
-}
\ No newline at end of file
+    word_t val = expr_eval(ex, success);
+    expr_free(ex);
+    return val;
+}
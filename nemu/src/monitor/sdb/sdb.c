@@ -15,18 +15,27 @@
 
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <cpu/breakpoint.h>
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "sdb.h"
 #include "memory/vaddr.h"
+#include "memory/paddr.h"
+#include "memory/host.h"
 
 static int is_batch_mode = false;
-
-void init_regex();
+static int gdb_port = 0;
+static const char *expr_test_file = NULL;
+static const char *script_file = NULL;
+static const char *dump_file = NULL;
+static FILE *dump_fp = NULL;
+static enum { DUMP_JSON, DUMP_BIN } dump_format = DUMP_JSON;
 
 void init_wp_pool();
 
-extern void wp_watch(char *expr, word_t res);
+extern void wp_watch(char *expr);
 
 extern void wp_remove(int no);
 
@@ -50,8 +59,26 @@ static char *rl_gets() {
     return line_read;
 }
 
+#ifdef CONFIG_FTRACE
+extern bool elf_symbol_addr(const char *name, vaddr_t *addr);
+extern const char *elf_symbol_name(vaddr_t addr);
+#endif
+
+static void bp_display(vaddr_t pc) {
+    const char *name = MUXDEF(CONFIG_FTRACE, elf_symbol_name(pc), NULL);
+    printf("Breakpoint at " FMT_WORD " <%s>\n", pc, name ? name : "??");
+}
+
+// report the breakpoint which stops the execution
+static void bp_report() {
+    if (nemu_state.state == NEMU_STOP && bp_check(cpu.pc)) {
+        bp_display(cpu.pc);
+    }
+}
+
 static int cmd_c(char *args) {
     cpu_exec(-1);
+    bp_report();
     return 0;
 }
 
@@ -75,6 +102,16 @@ static int cmd_w(char *args);
 
 static int cmd_d(char *args);
 
+static int cmd_b(char *args);
+
+static int cmd_clear(char *args);
+
+static int cmd_run(char *args);
+
+static int cmd_until(char *args);
+
+static int cmd_dump(char *args);
+
 static struct {
     const char *name;
     const char *description;
@@ -86,10 +123,15 @@ static struct {
         {"q",    "Exit NEMU",                                                                              cmd_q},
         {"si",   "Execute N instructions, the default is 1",                                               cmd_si},
         {"info", "Display the info of registers & watchpoints",                                            cmd_info},
-        {"x",    "Usage: x N EXPR. Scan the memory from EXPR by N bytes",                                  cmd_x},
+        {"x",    "Usage: x N EXPR. Scan N words of the memory from EXPR",                                   cmd_x},
         {"p",    "Usage: p EXPR. Calculate the expression, e.g. p $eax + 1",                               cmd_p},
         {"w",    "Usage: w EXPR. Watch for the variation of the result of EXPR, pause at variation point", cmd_w},
         {"d",    "Usage: d N. Delete watchpoint of wp.NO=N",                                               cmd_d},
+        {"b",    "Usage: b SYMBOL or b EXPR. Pause before executing the instruction at the address",       cmd_b},
+        {"clear","Usage: clear SYMBOL or clear EXPR. Delete the breakpoint at the address",                cmd_clear},
+        {"run",  "Usage: run [N]. Execute N instructions without printing them, the default is all",       cmd_run},
+        {"until","Usage: until EXPR. Execute until EXPR is not zero, checked after every instruction",     cmd_until},
+        {"dump", "Usage: dump r, or dump m N EXPR. Dump registers or N bytes from EXPR as JSON or binary", cmd_dump},
 
 
 
@@ -127,14 +169,16 @@ static int cmd_info(char *args) {
     /* extract the first argument */
     char *arg = strtok(NULL, " ");
     if (arg == NULL) {
-        printf("Usage: info r (registers) or info w (watchpoints)\n");
+        printf("Usage: info r (registers), info w (watchpoints) or info b (breakpoints)\n");
     } else {
         if (strcmp(arg, "r") == 0) {
             isa_reg_display();
         } else if (strcmp(arg, "w") == 0) {
             wp_iterate();
+        } else if (strcmp(arg, "b") == 0) {
+            bp_foreach(bp_display);
         } else {
-            printf("Usage: info r (registers) or info w (watchpoints)\n");
+            printf("Usage: info r (registers), info w (watchpoints) or info b (breakpoints)\n");
         }
     }
     return 0;
@@ -151,6 +195,7 @@ static int cmd_si(char *args) {
         n = strtol(arg, NULL, 10);
     }
     cpu_exec(n);
+    bp_report();
     return 0;
 }
 
@@ -160,22 +205,27 @@ static int cmd_x(char *args) {
         printf("Usage: x N EXPR\n");
         return 0;
     }
-    char *arg2 = strtok(NULL, " ");
+    // the expression is the rest of the line
+    char *arg2 = strtok(NULL, "");
     if (arg2 == NULL) {
         printf("Usage: x N EXPR\n");
         return 0;
     }
 
     int n = strtol(arg1, NULL, 10);
-    vaddr_t expr = strtol(arg2, NULL, 16);
+    bool success;
+    vaddr_t addr = expr(arg2, &success);
+    if (!success) return 0;
 
+    // read from pmem directly if the range is there
+    uint8_t *host = (in_pmem(addr) && in_pmem(addr + n * 4 - 1) ? guest_to_host(addr) : NULL);
     int i, j;
     for (i = 0; i < n;) {
-        printf(ANSI_FMT("%#010x: ", ANSI_FG_CYAN), expr);
+        printf(ANSI_FMT("%#010x: ", ANSI_FG_CYAN), addr);
         printf("| ");
         for (j = 0; i < n && j < 4; i++, j++) {
-            word_t w = vaddr_read(expr, 4);
-            expr += 4;
+            word_t w = (host ? host_read(host + i * 4, 4) : vaddr_read(addr, 4));
+            addr += 4;
             for (int k = 3; k >= 0; --k) {
                 printf("%02x ", (w >> (k * 8)) & 0xff);
             }
@@ -203,13 +253,7 @@ static int cmd_w(char *args) {
         printf("Usage: w EXPR\n");
         return 0;
     }
-    bool success;
-    word_t res = expr(args, &success);
-    if (!success) {
-        puts("invalid expression");
-    } else {
-        wp_watch(args, res);
-    }
+    wp_watch(args);
     return 0;
 }
 
@@ -224,85 +268,358 @@ static int cmd_d(char *args) {
     return 0;
 }
 
-void sdb_set_batch_mode() {
-    is_batch_mode = true;
+// the address of a breakpoint is given by the name of a function or an expression
+static bool bp_parse_addr(char *args, vaddr_t *addr) {
+    if (args == NULL) return false;
+#ifdef CONFIG_FTRACE
+    while (*args == ' ') args++;
+    if (elf_symbol_addr(args, addr)) return true;
+#endif
+    bool success;
+    *addr = expr(args, &success);
+    return success;
 }
 
-void sdb_mainloop() {
-    if (is_batch_mode) {
-        cmd_c(NULL);
+static int cmd_b(char *args) {
+    vaddr_t addr;
+    if (!bp_parse_addr(args, &addr)) {
+        printf("Usage: b SYMBOL or b EXPR\n");
+    } else if (!bp_insert(addr)) {
+        printf("Can not set a breakpoint at " FMT_WORD "\n", addr);
+    } else {
+        bp_display(addr);
+    }
+    return 0;
+}
+
+static int cmd_clear(char *args) {
+    vaddr_t addr;
+    if (!bp_parse_addr(args, &addr)) {
+        printf("Usage: clear SYMBOL or clear EXPR\n");
+    } else if (!bp_remove(addr)) {
+        printf("No breakpoint at " FMT_WORD "\n", addr);
+    } else {
+        printf("Deleted breakpoint at " FMT_WORD "\n", addr);
+    }
+    return 0;
+}
+
+static int cmd_run(char *args) {
+    char *arg = strtok(NULL, " ");
+    uint64_t n = (arg == NULL ? -1 : strtoull(arg, NULL, 10));
+    cpu_exec_quiet(n);
+    bp_report();
+    return 0;
+}
+
+static int cmd_until(char *args) {
+    if (args == NULL) {
+        printf("Usage: until EXPR\n");
+        return 0;
+    }
+    Expr *cond = expr_compile(args);
+    if (cond == NULL) return 0;
+    bool success = true;
+    word_t val = 0;
+    while (success && !val) {
+        cpu_exec_quiet(1);
+        // the program ends or stops at a breakpoint
+        if (nemu_state.state != NEMU_STOP || bp_check(cpu.pc)) break;
+        val = expr_eval(cond, &success);
+    }
+    expr_free(cond);
+    bp_report();
+    return 0;
+}
+
+/* A dump is a line of JSON, or a record of binary which starts with a
+ * DumpHeader and is followed by `len' bytes. The registers are dumped as
+ * the general purpose registers in order.
+ */
+typedef struct {
+    uint32_t type; // 'R' for registers, 'M' for memory
+    uint32_t addr; // the pc for registers
+    uint32_t len;
+} DumpHeader;
+
+#define NR_GPR ARRLEN(cpu.gpr)
+
+static void dump_regs() {
+    extern const char *regs[];
+    if (dump_format == DUMP_BIN) {
+        DumpHeader h = {.type = 'R', .addr = cpu.pc, .len = sizeof(cpu.gpr)};
+        fwrite(&h, sizeof(h), 1, dump_fp);
+        fwrite(cpu.gpr, sizeof(cpu.gpr), 1, dump_fp);
         return;
     }
+    fprintf(dump_fp, "{\"type\": \"regs\", \"pc\": %u, \"gpr\": {", cpu.pc);
+    for (int i = 0; i < NR_GPR; i++) {
+        fprintf(dump_fp, "%s\"%s\": %u", (i == 0 ? "" : ", "), regs[i], cpu.gpr[i]);
+    }
+    fprintf(dump_fp, "}}\n");
+}
 
-    for (char *str; (str = rl_gets()) != NULL;) {
-        char *str_end = str + strlen(str);
-
-        /* extract the first token as the command */
-        char *cmd = strtok(str, " ");
-        if (cmd == NULL) { continue; }
-
-        /* treat the remaining string as the arguments,
-         * which may need further parsing
-         */
-        char *args = cmd + strlen(cmd) + 1;
-        if (args >= str_end) {
-            args = NULL;
+static void dump_mem(paddr_t addr, uint32_t len) {
+    // the whole range is copied from pmem at once
+    uint8_t *host = guest_to_host(addr);
+    if (dump_format == DUMP_BIN) {
+        DumpHeader h = {.type = 'M', .addr = addr, .len = len};
+        fwrite(&h, sizeof(h), 1, dump_fp);
+        fwrite(host, len, 1, dump_fp);
+        return;
+    }
+    static const char hex[] = "0123456789abcdef";
+    char buf[4096];
+    fprintf(dump_fp, "{\"type\": \"mem\", \"addr\": %u, \"len\": %u, \"data\": \"", addr, len);
+    while (len > 0) {
+        uint32_t n = (len < sizeof(buf) / 2 ? len : sizeof(buf) / 2);
+        for (uint32_t i = 0; i < n; i++) {
+            buf[i * 2] = hex[host[i] >> 4];
+            buf[i * 2 + 1] = hex[host[i] & 0xf];
         }
+        fwrite(buf, n * 2, 1, dump_fp);
+        host += n;
+        len -= n;
+    }
+    fprintf(dump_fp, "\"}\n");
+}
+
+static int cmd_dump(char *args) {
+    char *arg = strtok(NULL, " ");
+    if (arg != NULL && strcmp(arg, "r") == 0) {
+        dump_regs();
+    } else if (arg != NULL && strcmp(arg, "m") == 0) {
+        char *arg1 = strtok(NULL, " ");
+        char *arg2 = strtok(NULL, "");
+        if (arg1 == NULL || arg2 == NULL) {
+            printf("Usage: dump m N EXPR\n");
+            return 0;
+        }
+        uint32_t len = strtoul(arg1, NULL, 0);
+        bool success;
+        paddr_t addr = expr(arg2, &success);
+        if (!success) return 0;
+        if (len == 0 || !in_pmem(addr) || !in_pmem(addr + len - 1) || addr + len - 1 < addr) {
+            printf("Can not dump %u bytes at " FMT_PADDR "\n", len, addr);
+            return 0;
+        }
+        dump_mem(addr, len);
+    } else {
+        printf("Usage: dump r, or dump m N EXPR\n");
+        return 0;
+    }
+    // stream the dumps to the reader
+    fflush(dump_fp);
+    return 0;
+}
+
+void sdb_set_batch_mode() {
+    is_batch_mode = true;
+}
+
+void sdb_set_gdb_mode(int port) {
+    gdb_port = port;
+}
+
+void sdb_set_expr_test(const char *file) {
+    expr_test_file = file;
+}
+
+void sdb_set_script(const char *file) {
+    script_file = file;
+}
+
+void sdb_set_dump(const char *file, const char *format) {
+    if (file != NULL) dump_file = file;
+    if (format == NULL) return;
+    if (strcmp(format, "json") == 0) dump_format = DUMP_JSON;
+    else if (strcmp(format, "bin") == 0) dump_format = DUMP_BIN;
+    else panic("unknown dump format '%s', which should be json or bin", format);
+}
+
+// execute a line of command, return -1 if NEMU should exit
+static int sdb_exec_line(char *str) {
+    char *str_end = str + strlen(str);
+
+    /* extract the first token as the command */
+    char *cmd = strtok(str, " ");
+    if (cmd == NULL) { return 0; }
+
+    /* treat the remaining string as the arguments,
+     * which may need further parsing
+     */
+    char *args = cmd + strlen(cmd) + 1;
+    if (args >= str_end) {
+        args = NULL;
+    }
 
 #ifdef CONFIG_DEVICE
-        extern void sdl_clear_event_queue();
-        sdl_clear_event_queue();
+    extern void sdl_clear_event_queue();
+    sdl_clear_event_queue();
 #endif
 
-        int i;
-        for (i = 0; i < NR_CMD; i++) {
-            if (strcmp(cmd, cmd_table[i].name) == 0) {
-                if (cmd_table[i].handler(args) < 0) { return; }
-                break;
-            }
+    int i;
+    for (i = 0; i < NR_CMD; i++) {
+        if (strcmp(cmd, cmd_table[i].name) == 0) {
+            return cmd_table[i].handler(args) < 0 ? -1 : 0;
         }
+    }
+
+    printf("Unknown command '%s'\n", cmd);
+    return 0;
+}
 
-        if (i == NR_CMD) { printf("Unknown command '%s'\n", cmd); }
+/* Run the commands in the script line by line, where '#' starts a comment.
+ * The script is read from stdin if the file is "-". NEMU exits when the
+ * script ends, and the exit status tells how the program ends.
+ */
+static void sdb_run_script(const char *file) {
+    FILE *fp = (strcmp(file, "-") == 0 ? stdin : fopen(file, "r"));
+    Assert(fp, "Can not open script '%s'", file);
+    char *line = NULL;
+    size_t size = 0;
+    int lineno = 0;
+    while (getline(&line, &size, fp) != -1) {
+        lineno++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) len--;
+        line[len] = '\0';
+        if (line[strspn(line, " \t")] == '\0') continue;
+        printf("(nemu:%d) %s\n", lineno, line);
+        if (sdb_exec_line(line) < 0) break;
+    }
+    free(line);
+    if (fp != stdin) fclose(fp);
+    if (nemu_state.state != NEMU_END && nemu_state.state != NEMU_ABORT) {
+        nemu_state.state = NEMU_QUIT;
     }
 }
 
-void test_expr() {
-    FILE *fp = fopen("/home/czy/course/NJU-ICS-PA/nemu/tools/gen-expr/input", "r");
-    if (fp == NULL) perror("test_expr error");
+void sdb_mainloop() {
+    if (gdb_port != 0) {
+        void gdb_mainloop(int port);
+        gdb_mainloop(gdb_port);
+        return;
+    }
 
-    char *e = NULL;
-    word_t correct_res;
-    size_t len = 0;
-    ssize_t read;
-    bool success = false;
+    if (script_file != NULL) {
+        sdb_run_script(script_file);
+        return;
+    }
 
-    while (true) {
-        if (fscanf(fp, "%u ", &correct_res) == -1) break;
-        read = getline(&e, &len, fp);
-        e[read - 1] = '\0';
+    if (is_batch_mode) {
+        cmd_c(NULL);
+        return;
+    }
 
-        word_t res = expr(e, &success);
+    for (char *str; (str = rl_gets()) != NULL;) {
+        if (sdb_exec_line(str) < 0) { return; }
+    }
+}
 
-        assert(success);
-        if (res != correct_res) {
-            puts(e);
-            printf("expected: %u, got: %u\n", correct_res, res);
-            assert(0);
+/* Check expr() with the cases generated by tools/gen-expr, each of which
+ * is a line of "RESULT EXPR". The cases are split among the host CPUs.
+ */
+#define MAX_EXPR_TEST_THREAD 64
+#define MAX_EXPR_FAIL_SHOWN 10
+
+typedef struct {
+    char **line;
+    int nr_line;
+    int first, step;
+    int nr_fail;
+} ExprTest;
+
+static void *expr_test_worker(void *arg) {
+    ExprTest *t = arg;
+    for (int i = t->first; i < t->nr_line; i += t->step) {
+        char *e;
+        word_t correct_res = strtoul(t->line[i], &e, 10);
+        bool success = false;
+        word_t res = expr(e, &success);
+        if (!success || res != correct_res) {
+            if (t->nr_fail++ < MAX_EXPR_FAIL_SHOWN) {
+                printf("%s\nexpected: %u, got: %u%s\n", e, correct_res, res, success ? "" : " (invalid)");
+            }
         }
     }
+    return NULL;
+}
 
+void test_expr(const char *file) {
+    FILE *fp = fopen(file, "r");
+    Assert(fp, "Can not open '%s'", file);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    assert(text);
+    size = fread(text, 1, size, fp);
+    text[size] = '\0';
     fclose(fp);
-    if (e) free(e);
 
-    Log("Expr test pass!");
+    // split the text into lines in place
+    int nr_line = 0, max_line = 1024;
+    char **line = malloc(sizeof(char *) * max_line);
+    for (char *s = text; *s != '\0';) {
+        char *next = strchr(s, '\n');
+        if (next) *next++ = '\0';
+        else next = s + strlen(s);
+        if (*s != '\0') {
+            if (nr_line == max_line) line = realloc(line, sizeof(char *) * (max_line *= 2));
+            line[nr_line++] = s;
+        }
+        s = next;
+    }
+
+    int nr_thread = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nr_thread < 1) nr_thread = 1;
+    if (nr_thread > MAX_EXPR_TEST_THREAD) nr_thread = MAX_EXPR_TEST_THREAD;
+    pthread_t thread[MAX_EXPR_TEST_THREAD];
+    ExprTest test[MAX_EXPR_TEST_THREAD];
+    for (int i = 0; i < nr_thread; i++) {
+        test[i] = (ExprTest) {.line = line, .nr_line = nr_line, .first = i, .step = nr_thread};
+        int ret = pthread_create(&thread[i], NULL, expr_test_worker, &test[i]);
+        Assert(ret == 0, "Can not create the thread for the expression test");
+    }
+    int nr_fail = 0;
+    for (int i = 0; i < nr_thread; i++) {
+        pthread_join(thread[i], NULL);
+        nr_fail += test[i].nr_fail;
+    }
+
+    free(line);
+    free(text);
+
+    Assert(nr_fail == 0, "%d of %d expressions fail", nr_fail, nr_line);
+    Log("Expr test pass! (%d expressions, %d threads)", nr_line, nr_thread);
+}
+
+/* A script dumping to stdout keeps stdout for the dumps alone, and the rest
+ * NEMU prints, such as the echo of the commands and the log, goes to stderr.
+ * This is done before the log is opened, since it may be written to stdout.
+ */
+void init_sdb_stdout() {
+    if (script_file == NULL || dump_file != NULL) return;
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0 || (dump_fp = fdopen(fd, "w")) == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("Can not keep stdout for the dumps");
+        exit(1);
+    }
 }
 
 void init_sdb() {
-    /* Compile the regular expressions. */
-    init_regex();
+    if (dump_fp == NULL) {
+        Assert(dump_file != NULL || dump_format != DUMP_BIN,
+               "The binary dumps are only written to a file given by -o, or to stdout by a script");
+        dump_fp = (dump_file == NULL ? stdout : fopen(dump_file, "w"));
+        Assert(dump_fp, "Can not open dump file '%s'", dump_file);
+    }
 
     /* test math expression calculation. */
-    test_expr();
+    if (expr_test_file != NULL) test_expr(expr_test_file);
 
     /* Initialize the watchpoint pool. */
     init_wp_pool();
@@ -18,6 +18,12 @@
 
 #include <common.h>
 
-word_t expr(char *e, bool *success);
+typedef struct Expr Expr;
+
+word_t expr(const char *e, bool *success);
+// the AST of an expression can be evaluated for many times
+Expr *expr_compile(const char *e);
+word_t expr_eval(const Expr *ex, bool *success);
+void expr_free(Expr *ex);
 
 #endif
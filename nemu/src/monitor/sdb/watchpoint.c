@@ -23,6 +23,7 @@ typedef struct watchpoint {
 
     /* TODO: Add more members if necessary */
     char *expr;
+    Expr *ast; // compiled once, evaluated after every instruction
     word_t old;
 
 } WP;
@@ -58,7 +59,7 @@ WP *new_wp() {
 void free_wp(WP *wp) {
     WP *h = head;
     if (h == wp) {
-        head = NULL;
+        head = wp->next;
     } else {
         while (h && h->next != wp) h = h->next;
         Assert(h, "head not exist");
@@ -70,10 +71,19 @@ void free_wp(WP *wp) {
     free_ = wp;
 }
 
-void wp_watch(char *expr, word_t res) {
+void wp_watch(char *expr) {
+    Expr *ast = expr_compile(expr);
+    if (ast == NULL) return;
+    bool success;
+    word_t res = expr_eval(ast, &success);
+    if (!success) {
+        expr_free(ast);
+        return;
+    }
     WP *wp = new_wp();
     wp->expr = (char *) malloc(strlen(expr) + 1);
     strcpy(wp->expr, expr);
+    wp->ast = ast;
     wp->old = res;
     printf("Watchpoint %d: %s\n", wp->NO, expr);
 }
@@ -83,6 +93,10 @@ void wp_remove(int no) {
     WP *wp = &wp_pool[no];
     free_wp(wp);
     printf("Delete watchpoint %d: %s\n", wp->NO, wp->expr);
+    free(wp->expr);
+    expr_free(wp->ast);
+    wp->expr = NULL;
+    wp->ast = NULL;
 }
 
 void wp_iterate() {
@@ -103,7 +117,7 @@ void wp_difftest() {
     bool if_changed = false;
     while (h) {
         bool _;
-        word_t new = expr(h->expr, &_);
+        word_t new = expr_eval(h->ast, &_);
         if (h->old != new) {
             printf("Watchpoint %d: %s\n"
                    "Old value = 0x%08x\n"
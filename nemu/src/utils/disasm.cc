@@ -31,6 +31,10 @@
 #include "llvm/Support/TargetRegistry.h"
 #endif
 #include "llvm/Support/TargetSelect.h"
+#include <generated/autoconf.h>
+#if defined(CONFIG_MULTI_INSTANCE) || defined(CONFIG_MULTI_HART)
+#include <mutex>
+#endif
 
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC diagnostic pop
@@ -93,6 +97,11 @@ extern "C" void init_disasm(const char *triple) {
 }
 
 extern "C" void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
+#if defined(CONFIG_MULTI_INSTANCE) || defined(CONFIG_MULTI_HART)
+  // the disassembler is shared by all threads
+  static std::mutex lock;
+  std::lock_guard<std::mutex> guard(lock);
+#endif
   MCInst inst;
   llvm::ArrayRef<uint8_t> arr(code, nbyte);
   uint64_t dummy_size = 0;
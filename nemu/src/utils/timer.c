@@ -21,7 +21,7 @@ IFDEF(CONFIG_TIMER_CLOCK_GETTIME,
 IFDEF(CONFIG_TIMER_CLOCK_GETTIME,
     static_assert(sizeof(clock_t) == 8, "sizeof(clock_t) != 8"));
 
-static uint64_t boot_time = 0;
+static MACHINE_LOCAL uint64_t boot_time = 0;
 
 static uint64_t get_time_internal() {
 #if defined(CONFIG_TARGET_AM)
@@ -14,9 +14,9 @@ typedef struct
     uint32_t inst;
 }InstBuf;
 
-InstBuf iringbuf[INST_NUM];
+HART_LOCAL InstBuf iringbuf[INST_NUM];
 
-int cur_inst = 0;
+HART_LOCAL int cur_inst = 0;
 
 void trace_inst(word_t pc, uint32_t inst)
 {
@@ -94,68 +94,57 @@ void load_elf_and_parse(const char *elf_file) {
         exit(0);
     }
 
+    //读取节头表
+    Elf32_Shdr *shdr = malloc(sizeof(Elf32_Shdr) * edhr.e_shnum);
     fseek(fp, edhr.e_shoff, SEEK_SET);
-
-    Elf32_Shdr shdr;
-    char *string_table = NULL;
-    //寻找字符串表
-    for (int i = 0; i < edhr.e_shnum; i++) {
-        if (fread(&shdr, sizeof(Elf32_Shdr), 1, fp) <= 0) {
-            printf("fail to read the shdr\n");
-            exit(0);
-        }
-
-        if (shdr.sh_type == SHT_STRTAB) {
-            //获取字符串表
-            string_table = malloc(shdr.sh_size);
-            fseek(fp, shdr.sh_offset, SEEK_SET);
-            if (fread(string_table, shdr.sh_size, 1, fp) <= 0) {
-                printf("fail to read the strtab\n");
-                exit(0);
-            }
-        }
+    if (fread(shdr, sizeof(Elf32_Shdr), edhr.e_shnum, fp) != edhr.e_shnum) {
+        printf("fail to read the shdr\n");
+        exit(0);
     }
 
-    //寻找符号表
-    fseek(fp, edhr.e_shoff, SEEK_SET);
-
+    //寻找符号表, 以及它通过sh_link指向的字符串表
     for (int i = 0; i < edhr.e_shnum; i++) {
-        if (fread(&shdr, sizeof(Elf32_Shdr), 1, fp) <= 0) {
-            printf("fail to read the shdr\n");
+        if (shdr[i].sh_type != SHT_SYMTAB) continue;
+
+        Elf32_Shdr *strtab = &shdr[shdr[i].sh_link];
+        char *string_table = malloc(strtab->sh_size);
+        fseek(fp, strtab->sh_offset, SEEK_SET);
+        if (fread(string_table, strtab->sh_size, 1, fp) <= 0) {
+            printf("fail to read the strtab\n");
             exit(0);
         }
 
-        if (shdr.sh_type == SHT_SYMTAB) {
-            fseek(fp, shdr.sh_offset, SEEK_SET);
+        fseek(fp, shdr[i].sh_offset, SEEK_SET);
 
-            Elf32_Sym sym;
+        Elf32_Sym sym;
 
-            size_t sym_count = shdr.sh_size / shdr.sh_entsize;
-            symbol = malloc(sizeof(Symbol) * sym_count);
+        size_t sym_count = shdr[i].sh_size / shdr[i].sh_entsize;
+        symbol = malloc(sizeof(Symbol) * sym_count);
 
-            for (size_t j = 0; j < sym_count; j++) {
-                if (fread(&sym, sizeof(Elf32_Sym), 1, fp) <= 0) {
-                    printf("fail to read the symtab\n");
-                    exit(0);
-                }
+        for (size_t j = 0; j < sym_count; j++) {
+            if (fread(&sym, sizeof(Elf32_Sym), 1, fp) <= 0) {
+                printf("fail to read the symtab\n");
+                exit(0);
+            }
 
-                if (ELF32_ST_TYPE(sym.st_info) == STT_FUNC) {
-                    const char *name = string_table + sym.st_name;
-                    strncpy(symbol[func_num].name, name, sizeof(symbol[func_num].name) - 1);
-                    symbol[func_num].addr = sym.st_value;
-                    symbol[func_num].size = sym.st_size;
-                    func_num++;
-                }
+            if (ELF32_ST_TYPE(sym.st_info) == STT_FUNC) {
+                const char *name = string_table + sym.st_name;
+                strncpy(symbol[func_num].name, name, sizeof(symbol[func_num].name) - 1);
+                symbol[func_num].addr = sym.st_value;
+                symbol[func_num].size = sym.st_size;
+                func_num++;
             }
         }
+        free(string_table);
+        break;
     }
 //    Log("func_num: %d, ")
     fclose(fp);
-    free(string_table);
+    free(shdr);
 }
 
 
-static int rec_depth = 1;
+static HART_LOCAL int rec_depth = 1;
 
 void display_call_func(word_t pc, word_t func_addr) {
 //    for(int i = 0; i <= func_num; i++) {
@@ -200,6 +189,27 @@ void display_ret_func(word_t pc) {
     printf("ret  [%s]\n", symbol[i].name);
 }
 
+// look up the address of the function `name', used by the breakpoints of sdb
+bool elf_symbol_addr(const char *name, vaddr_t *addr) {
+    for (size_t i = 0; i < func_num; i++) {
+        if (strcmp(symbol[i].name, name) == 0) {
+            *addr = symbol[i].addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+// the name of the function containing `addr', or NULL if it is unknown
+const char *elf_symbol_name(vaddr_t addr) {
+    for (size_t i = 0; i < func_num; i++) {
+        if (addr >= symbol[i].addr && addr < symbol[i].addr + symbol[i].size) {
+            return symbol[i].name;
+        }
+    }
+    return NULL;
+}
+
 #endif
 
 #ifdef CONFIG_DTRACE
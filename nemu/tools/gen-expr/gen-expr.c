@@ -5,177 +5,174 @@
 #include <assert.h>
 #include <string.h>
 
-// this should be enough
+/* Each case is a line of "RESULT EXPR". The expression is written to `buf'
+ * while it is generated, and its value is computed at the same time with
+ * the semantics of expr() in sdb: all values are uint32_t, binary operators
+ * are left associative, and the precedence from low to high is
+ *   ||  &&  == !=  + -  * /  unary -
+ * A divisor which turns out to be zero is generated again.
+ */
+
+// this should be enough, see MAX_TOKEN
 static char buf[65536] = {};
-static char output_buf[65536] = {};
-static char code_buf[65536 + 128] = {}; // a little larger than `buf`
-static char *code_format =
-        "#include <stdio.h>\n"
-        "int main() { "
-        "  unsigned result = (%s); "
-        "  printf(\"%%u\", result); "
-        "  return 0; "
-        "}";
-
-
-uint32_t perform(uint32_t n1, uint32_t n2, char op) {
-    switch (op) {
-        case '+':
-            return n1 + n2;
-        case '-':
-            return n1 - n2;
-        case '*':
-            return n1 * n2;
-        case '/':
-            return n1 / n2;
-        default:
-            return 0;
-    }
-}
-
-uint32_t choose(uint32_t n) {
+static char *p = buf;
+
+// the tokens of an expression are limited by the token array of expr()
+#define MAX_TOKEN 512
+static int nr_token = 0;
+
+enum { PREC_OR, PREC_AND, PREC_EQ, PREC_ADD, PREC_MUL, PREC_UNARY };
+
+static const struct {
+    const char *str;
+    int prec;
+} ops[] = {
+        {"||", PREC_OR},
+        {"&&", PREC_AND},
+        {"==", PREC_EQ},
+        {"!=", PREC_EQ},
+        {"+",  PREC_ADD},
+        {"-",  PREC_ADD},
+        {"*",  PREC_MUL},
+        {"/",  PREC_MUL},
+};
+
+#define NR_OP (sizeof(ops) / sizeof(ops[0]))
+
+static uint32_t choose(uint32_t n) {
     return rand() % n;
 }
 
-void gen(char c) {
-    char cha_buffer[2] = {c, '\0'};
-    strcat(buf, cha_buffer);
-}
-
-char gen_rand_op() {
-    switch (choose(4)) {
-        case 0:
-            gen('+');
-            return '+';
-        case 1:
-            gen('-');
-            return '-';
-        case 2:
-            gen('*');
-            return '*';
-        case 3:
-            gen('/');
-            return '/';
-    }
-    return ' ';
-}
-
-uint32_t gen_num() {
-    char num_buffer[1024];
-    num_buffer[0] = '\0';
-    uint32_t number = rand() % 100 + 1;
-    sprintf(num_buffer, "%du", number);
-    strcat(buf, num_buffer);
-    return number;
-}
-
-void generate_output() {
-    int j = 0;
-    for (int i = 0; buf[i] != '\0'; ++i) {
-        if (buf[i] != 'u') {
-            output_buf[j++] = buf[i];
-        }
-    }
-    output_buf[j] = '\0';
+static void gen(const char *s) {
+    while (*s) *p++ = *s++;
+    nr_token++;
 }
 
 #define INSERT_BLANK
 
-
 static void gen_rand_blank() {
 #ifdef INSERT_BLANK
     switch (choose(7)) {
-        case 0:
-        case 1:
-        case 2:
-        case 3:
-            break;
-
         case 4:
         case 5:
-            strcat(buf, " ");
+            *p++ = ' ';
             break;
-
         case 6:
-            strcat(buf, "  ");
+            *p++ = ' ';
+            *p++ = ' ';
+            break;
+        default:
             break;
     }
 #endif
 }
 
-static void gen_rand_expr(int depth) {
-    if (strlen(buf) > 65536 - 10000 || depth > 15) {
-        gen('(');
-        gen_rand_blank();
-        gen_num();
-        gen_rand_blank();
-        gen(')');
-        return;
-    }
-
-    switch (choose(3)) {
+static uint32_t gen_num() {
+    uint32_t n;
+    switch (choose(8)) {
         case 0:
-            gen_num();
-            gen_rand_blank();
+            n = 0;
             break;
-
         case 1:
-            gen('(');
-            gen_rand_blank();
-            gen_rand_expr(depth + 1);
-            gen_rand_blank();
-            gen(')');
+            n = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
             break;
+        default:
+            n = choose(100) + 1;
+            break;
+    }
+    if (choose(4) == 0) {
+        p += sprintf(p, "0x%x", n);
+    } else {
+        p += sprintf(p, "%u", n);
+    }
+    nr_token++;
+    return n;
+}
 
-        default: {
-            gen_rand_expr(depth + 1);
+static uint32_t calc(int op, uint32_t a, uint32_t b) {
+    switch (op) {
+        case 0: return a || b;
+        case 1: return a && b;
+        case 2: return a == b;
+        case 3: return a != b;
+        case 4: return a + b;
+        case 5: return a - b;
+        case 6: return a * b;
+        default: return a / b;
+    }
+}
+
+static uint32_t gen_rand_expr(int prec, int depth);
+
+// a number, a parenthesized expression or the negation of them
+static uint32_t gen_rand_atom(int depth) {
+    if (nr_token >= MAX_TOKEN || depth > 15) {
+        return gen_num();
+    }
+    switch (choose(4)) {
+        case 0: {
+            gen("(");
             gen_rand_blank();
-            gen_rand_op();
+            uint32_t v = gen_rand_expr(PREC_OR, depth + 1);
             gen_rand_blank();
-            gen_rand_expr(depth + 1);
-            break;
+            gen(")");
+            return v;
         }
+        case 1:
+            gen("-");
+            gen_rand_blank();
+            return -gen_rand_atom(depth + 1);
+        default:
+            return gen_num();
+    }
+}
+
+// an expression whose operators at the top level bind no looser than `prec'
+static uint32_t gen_rand_expr(int prec, int depth) {
+    if (prec == PREC_UNARY || nr_token >= MAX_TOKEN || depth > 15 || choose(3) == 0) {
+        return gen_rand_atom(depth);
     }
+
+    int op;
+    do {
+        op = choose(NR_OP);
+    } while (ops[op].prec < prec);
+
+    // the left operand may hold the same operators for left associativity
+    uint32_t a = gen_rand_expr(ops[op].prec, depth + 1);
+    gen_rand_blank();
+    gen(ops[op].str);
+    gen_rand_blank();
+    char *rhs = p;
+    int rhs_token = nr_token;
+    uint32_t b;
+    do {
+        p = rhs;
+        nr_token = rhs_token;
+        b = gen_rand_expr(ops[op].prec + 1, depth + 1);
+    } while (b == 0 && ops[op].str[0] == '/');
+    return calc(op, a, b);
 }
 
 int main(int argc, char *argv[]) {
-    //stderr = NULL;
-    int seed = time(0);
-    srand(seed);
     int loop = 1;
+    unsigned seed = time(0);
     if (argc > 1) {
         sscanf(argv[1], "%d", &loop);
     }
+    if (argc > 2) {
+        sscanf(argv[2], "%u", &seed);
+    }
+    srand(seed);
+
     int i;
     for (i = 0; i < loop; i++) {
-        buf[0] = '\0';
-        gen_rand_expr(0);
-        generate_output();
-
-        sprintf(code_buf, code_format, buf);
-        FILE *fp = fopen("/tmp/.code.c", "w");
-        assert(fp != NULL);
-        fputs(code_buf, fp);
-        fclose(fp);
-
-        int ret = system("gcc /tmp/.code.c -o /tmp/.expr -Werror 2> /tmp/.error.txt");
-        if (ret != 0) {
-            i--;
-            continue;
-        }
-
-        fp = popen("/tmp/.expr", "r");
-        assert(fp != NULL);
-
-        uint32_t result = 0u;
-        int b = fscanf(fp, "%u", &result);
-        pclose(fp);
-        if (b != 1) {
-            i--;
-            continue;
-        }
-
-        printf("%u %s\n", result, output_buf);
+        p = buf;
+        nr_token = 0;
+        uint32_t result = gen_rand_expr(PREC_OR, 0);
+        *p = '\0';
+        assert(p < buf + sizeof(buf));
+        printf("%u %s\n", result, buf);
     }
     return 0;
-}
\ No newline at end of file
+}